@@ -0,0 +1,534 @@
+/*******************************************************************************
+ * bench_main.cpp — Host benchmark for the fuel_counter counting hot path
+ *
+ * Runs the lane state machine over synthetic (and optionally recorded)
+ * distance streams and reports ns per reading and readings / counts per
+ * second, so hot-path regressions show up on a laptop before flashing.
+ *
+ *   pio run -e native && .pio/build/native/program [stream.csv]
+ *
+ * A recorded stream is CSV, one sample per line:  ts_ms,lane,distance_mm
+ * (lines starting with '#' are ignored).  Every path must count the same
+ * number of balls; a mismatch exits non-zero, as does a failed self-check
+ * of the non-timed helpers (stored config image, count bins).
+ ******************************************************************************/
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "fuel_counter.h"
+#include "count_bins.h"
+#include "histogram.h"
+#include "sample_filter.h"
+#include "stored_config.h"
+
+// ═══════════════════════════════════════════════════════════════════════════
+//  CONFIGURATION  (mirrors src/main.cpp defaults)
+// ═══════════════════════════════════════════════════════════════════════════
+
+static const uint16_t BASELINE_MM         = 300;
+static const uint16_t DETECTION_DELTA_MM  = 80;
+static const uint16_t CLEAR_HYSTERESIS_MM = 30;
+static const uint32_t LOCKOUT_MS          = 60;
+static const uint32_t SAMPLE_PERIOD_MS    = 20;     // high-speed profile
+static const uint8_t  ADAPT_DWELL_PCT     = 50;     // adaptive lockout runs
+static const uint8_t  MAX_BALLS_PER_PASS  = 3;
+static const uint16_t MULTI_BALL_DIP_MM   = 20;
+static const uint8_t  DRIFT_SHIFT         = 6;      // baseline drift tracking
+static const uint16_t DRIFT_STEP_Q8       = 8;
+static const uint16_t DRIFT_WINDOW_MM     = 25;
+static const uint16_t DRIFT_LIMIT_MM      = 60;
+static const uint16_t DRIFT_SPAN_MM       = 50;     // how far the wall wanders
+static const uint32_t SYNTH_FRAMES        = 200000; // frames per lane set
+static const double   MIN_RUN_SECONDS     = 0.25;   // repeat until this long
+
+// ═══════════════════════════════════════════════════════════════════════════
+//  STREAMS
+// ═══════════════════════════════════════════════════════════════════════════
+
+// One frame = one reading per lane sharing a timestamp (lane-major order).
+struct FrameStream {
+  uint8_t               lanes = 0;
+  std::vector<uint32_t> ts;
+  std::vector<uint16_t> dist;       // ts.size() × lanes
+  uint32_t              balls = 0;  // balls injected (expected count)
+};
+
+// One reading at a time, as the IRQ path delivers them.
+struct Sample {
+  uint32_t ts;
+  uint8_t  lane;
+  uint16_t dist;
+};
+
+static uint32_t rngState = 0x1234567u;
+static uint32_t rng() {
+  rngState = rngState * 1664525u + 1013904223u;
+  return rngState >> 8;
+}
+
+/**
+ * Noisy empty-lane baseline with balls dropped in at random gaps.  A ball
+ * covers 2–4 frames and is always followed by enough clear frames to get
+ * through lockout, so every injected ball should be counted exactly once.
+ */
+static FrameStream makeSynthetic(uint8_t lanes, uint32_t frames) {
+  FrameStream s;
+  s.lanes = lanes;
+  s.ts.resize(frames);
+  s.dist.resize((size_t)frames * lanes);
+  for (uint32_t f = 0; f < frames; f++) s.ts[f] = f * SAMPLE_PERIOD_MS;
+
+  const uint32_t guard = LOCKOUT_MS / SAMPLE_PERIOD_MS + 2;
+  for (uint8_t l = 0; l < lanes; l++) {
+    uint32_t f = 0;
+    while (f < frames) {
+      uint32_t gap = guard + rng() % 24;
+      // Clear stretch
+      for (uint32_t k = 0; k < gap && f < frames; k++, f++) {
+        s.dist[(size_t)f * lanes + l] = BASELINE_MM - 4 + rng() % 9;
+      }
+      // Ball (only if it fits with its trailing clear frames)
+      uint32_t dwell = 2 + rng() % 3;
+      if (f + dwell + guard >= frames) continue;
+      for (uint32_t k = 0; k < dwell; k++, f++) {
+        s.dist[(size_t)f * lanes + l] = 120 + rng() % 60;
+      }
+      s.balls++;
+    }
+  }
+  return s;
+}
+
+/**
+ * Copy of a stream with single-frame short spikes (ambient light,
+ * crosstalk) dropped onto clear frames.  The filtered paths must still
+ * count only the real balls.
+ */
+static FrameStream addSpikes(const FrameStream& in, uint32_t everyFrames) {
+  FrameStream s = in;
+  const uint16_t clear = BASELINE_MM - 10;
+  for (uint8_t l = 0; l < s.lanes; l++) {
+    // At least 3 frames apart: two spikes inside one window beat any median-of-3.
+    // None in the first 2 frames either, which the filter passes unfiltered.
+    for (size_t f = 3 + rng() % everyFrames; f + 1 < s.ts.size(); f += 3 + rng() % everyFrames) {
+      uint16_t* d = &s.dist[f * s.lanes + l];
+      if (d[-(int)s.lanes] < clear || d[0] < clear || d[s.lanes] < clear) continue;
+      d[0] = 60 + rng() % 100;
+    }
+  }
+  return s;
+}
+
+/**
+ * Passes of 1–MAX_BALLS_PER_PASS touching balls.  Each ball blocks the beam
+ * for 2 frames and consecutive balls are split by one frame that rises well
+ * past MULTI_BALL_DIP_MM but never clears, so only multi-ball inference
+ * can count them; balls holds the true ball count.
+ */
+static FrameStream makeTouching(uint8_t lanes, uint32_t frames) {
+  FrameStream s;
+  s.lanes = lanes;
+  s.ts.resize(frames);
+  s.dist.resize((size_t)frames * lanes);
+  for (uint32_t f = 0; f < frames; f++) s.ts[f] = f * SAMPLE_PERIOD_MS;
+
+  const uint32_t guard = LOCKOUT_MS / SAMPLE_PERIOD_MS + 2;
+  for (uint8_t l = 0; l < lanes; l++) {
+    uint32_t f = 0;
+    while (f < frames) {
+      uint32_t gap = guard + rng() % 24;
+      for (uint32_t k = 0; k < gap && f < frames; k++, f++) {
+        s.dist[(size_t)f * lanes + l] = BASELINE_MM - 4 + rng() % 9;
+      }
+      uint8_t  balls = (uint8_t)(1 + rng() % MAX_BALLS_PER_PASS);
+      uint32_t len   = 3u * balls - 1;
+      if (f + len + guard >= frames) continue;
+      for (uint32_t k = 0; k < len; k++, f++) {
+        bool gapFrame = k % 3 == 2;          // between two balls
+        s.dist[(size_t)f * lanes + l] = gapFrame ? 195 + rng() % 11 : 140 + rng() % 21;
+      }
+      s.balls += balls;
+    }
+  }
+  return s;
+}
+
+/**
+ * Single balls at a steady speed while the empty-lane wall wanders slowly
+ * down by DRIFT_SPAN_MM and back (a warming sensor, a sagging mount).  At
+ * the bottom the noisy empty reading sits on the fixed clear threshold, so
+ * only drift tracking keeps counting; balls stay below the tracked
+ * threshold throughout.
+ */
+static FrameStream makeDrifting(uint8_t lanes, uint32_t frames) {
+  FrameStream s;
+  s.lanes = lanes;
+  s.ts.resize(frames);
+  s.dist.resize((size_t)frames * lanes);
+  for (uint32_t f = 0; f < frames; f++) s.ts[f] = f * SAMPLE_PERIOD_MS;
+
+  auto wall = [&](uint32_t f) {
+    uint32_t half = frames / 2;
+    uint32_t down = f < half ? f : frames - f;
+    return (uint16_t)(BASELINE_MM - (uint32_t)DRIFT_SPAN_MM * down / half);
+  };
+  const uint32_t guard = LOCKOUT_MS / SAMPLE_PERIOD_MS + 2;
+  for (uint8_t l = 0; l < lanes; l++) {
+    uint32_t f = 0;
+    while (f < frames) {
+      uint32_t gap = guard + rng() % 24;
+      for (uint32_t k = 0; k < gap && f < frames; k++, f++) {
+        s.dist[(size_t)f * lanes + l] = wall(f) - 4 + rng() % 9;
+      }
+      uint32_t dwell = 3 + rng() % 2;     // < 1.75× spread: one ball each
+      if (f + dwell + guard >= frames) continue;
+      for (uint32_t k = 0; k < dwell; k++, f++) {
+        s.dist[(size_t)f * lanes + l] = wall(f) - 150 + rng() % 15;   // no false dips
+      }
+      s.balls++;
+    }
+  }
+  return s;
+}
+
+static bool loadCsv(const char* path, std::vector<Sample>& out, uint8_t& lanes) {
+  FILE* fp = std::fopen(path, "r");
+  if (!fp) return false;
+  char line[96];
+  lanes = 0;
+  while (std::fgets(line, sizeof(line), fp)) {
+    if (line[0] == '#' || line[0] == '\n') continue;
+    unsigned long ts, lane, dist;
+    if (std::sscanf(line, "%lu,%lu,%lu", &ts, &lane, &dist) != 3) continue;
+    if (lane >= 32) continue;
+    out.push_back({(uint32_t)ts, (uint8_t)lane, (uint16_t)dist});
+    if (lane + 1 > lanes) lanes = (uint8_t)(lane + 1);
+  }
+  std::fclose(fp);
+  return true;
+}
+
+// ═══════════════════════════════════════════════════════════════════════════
+//  TIMING HARNESS
+// ═══════════════════════════════════════════════════════════════════════════
+
+static int failures = 0;
+
+/**
+ * Repeat pass() until MIN_RUN_SECONDS have elapsed and report the fastest
+ * pass.  pass() returns the number of balls it counted; ops is the number
+ * of readings (or calls) per pass.
+ */
+template <typename Pass>
+static void runBench(const char* name, uint64_t ops, long expected, Pass pass) {
+  using clock = std::chrono::steady_clock;
+  double best = 1e30, total = 0;
+  long counted = -1;
+  do {
+    auto t0 = clock::now();
+    long c = pass();
+    double dt = std::chrono::duration<double>(clock::now() - t0).count();
+    if (dt < best) best = dt;
+    total += dt;
+    if (counted >= 0 && c != counted) counted = -2;   // non-deterministic
+    else if (counted != -2) counted = c;
+  } while (total < MIN_RUN_SECONDS);
+
+  double ns = best * 1e9 / (double)ops;
+  std::printf("%-44s %8.2f ns/op  %8.2f Mop/s", name, ns, ops / best / 1e6);
+  if (expected >= 0) {
+    std::printf("  %10.0f counts/s", counted / best);
+    if (counted != expected) {
+      std::printf("  MISMATCH counted %ld expected %ld", counted, expected);
+      failures++;
+    }
+  }
+  std::printf("\n");
+}
+
+static volatile uint32_t sink;   // keeps results observable to the optimiser
+
+// ═══════════════════════════════════════════════════════════════════════════
+//  BENCHMARKS
+// ═══════════════════════════════════════════════════════════════════════════
+
+static void initLane(Lane& lane) {
+  lane = Lane();
+  lane.sensorOk = true;
+  calculateThresholds(lane, BASELINE_MM, DETECTION_DELTA_MM, CLEAR_HYSTERESIS_MM);
+}
+
+// LaneBank features switched on for a run (the firmware enables all three).
+enum : uint8_t {
+  OPT_ADAPT = 1u << 0,    // adaptive lockout
+  OPT_MULTI = 1u << 1,    // multi-ball inference
+  OPT_DRIFT = 1u << 2,    // baseline drift tracking
+  OPT_ALL   = OPT_ADAPT | OPT_MULTI | OPT_DRIFT,
+};
+
+template <uint8_t N>
+static void initBank(LaneBank<N>& bank, uint8_t opts = 0) {
+  bank = LaneBank<N>();
+  bank.setLockout(LOCKOUT_MS);
+  // Capped at LOCKOUT_MS so the synthetic gaps still clear every lockout
+  bank.setAdaptiveLockout((opts & OPT_ADAPT) ? ADAPT_DWELL_PCT : 0, 15, LOCKOUT_MS);
+  if (opts & OPT_MULTI) bank.setMultiBall(MAX_BALLS_PER_PASS, MULTI_BALL_DIP_MM);
+  if (opts & OPT_DRIFT) {
+    bank.setDriftTracking(DRIFT_SHIFT, DRIFT_STEP_Q8, DRIFT_WINDOW_MM, DRIFT_LIMIT_MM);
+  }
+  for (uint8_t i = 0; i < N; i++) {
+    bank.setSensorOk(i, true);
+    bank.calculateThresholds(i, BASELINE_MM, DETECTION_DELTA_MM, CLEAR_HYSTERESIS_MM);
+  }
+}
+
+// Lane (array-of-structs) path: one processLaneReading() per reading.
+static void benchLaneScalar(const FrameStream& s) {
+  char name[48];
+  std::snprintf(name, sizeof(name), "processLaneReading  x%u", s.lanes);
+  const uint64_t ops = (uint64_t)s.ts.size() * s.lanes;
+  runBench(name, ops, s.balls, [&]() {
+    std::vector<Lane> lanes(s.lanes);
+    for (Lane& l : lanes) initLane(l);
+    long counted = 0;
+    for (size_t f = 0; f < s.ts.size(); f++) {
+      const uint16_t* d = &s.dist[f * s.lanes];
+      for (uint8_t i = 0; i < s.lanes; i++) {
+        counted += processLaneReading(lanes[i], d[i], s.ts[f], LOCKOUT_MS);
+      }
+    }
+    return counted;
+  });
+}
+
+// LaneBank batch path: one processReadings() per frame.  Counts are read
+// back from count[] since a multi-ball pass adds more than one per call.
+template <uint8_t N>
+static void benchBankBatch(const FrameStream& s, uint8_t opts = 0, const char* tag = "") {
+  char name[48];
+  std::snprintf(name, sizeof(name), "LaneBank<%u>::processReadings%s%s", N,
+                opts == OPT_ALL ? " +all" : (opts & OPT_ADAPT) ? " +adapt" : "", tag);
+  const uint64_t ops = (uint64_t)s.ts.size() * N;
+  runBench(name, ops, s.balls, [&]() {
+    static LaneBank<N> bank;
+    initBank(bank, opts);
+    for (size_t f = 0; f < s.ts.size(); f++) {
+      bank.processReadings(&s.dist[f * N], s.ts[f]);
+    }
+    long counted = 0;
+    for (uint8_t i = 0; i < N; i++) counted += bank.count[i];
+    return counted;
+  });
+}
+
+// LaneBank single-lane path, as the IRQ drain uses it.
+template <uint8_t N>
+static void benchBankSingle(const FrameStream& s) {
+  char name[48];
+  std::snprintf(name, sizeof(name), "LaneBank<%u>::process", N);
+  const uint64_t ops = (uint64_t)s.ts.size() * N;
+  runBench(name, ops, s.balls, [&]() {
+    static LaneBank<N> bank;
+    initBank(bank);
+    long counted = 0;
+    for (size_t f = 0; f < s.ts.size(); f++) {
+      const uint16_t* d = &s.dist[f * N];
+      for (uint8_t i = 0; i < N; i++) counted += bank.process(i, d[i], s.ts[f]);
+    }
+    return counted;
+  });
+}
+
+// Sample filter (median of 3) in front of the batch path.
+template <uint8_t N>
+static void benchBankFiltered(const FrameStream& s, const char* tag) {
+  char name[48];
+  std::snprintf(name, sizeof(name), "filter+LaneBank<%u> %s", N, tag);
+  const uint64_t ops = (uint64_t)s.ts.size() * N;
+  runBench(name, ops, s.balls, [&]() {
+    static LaneBank<N> bank;
+    static SampleFilterBank<N> filter;
+    initBank(bank);
+    filter = SampleFilterBank<N>();
+    long counted = 0;
+    uint16_t frame[N];
+    for (size_t f = 0; f < s.ts.size(); f++) {
+      for (uint8_t i = 0; i < N; i++) frame[i] = s.dist[f * N + i];
+      uint32_t m = filter.filterReadings(frame, nullptr, nullptr, LaneBank<N>::ALL_MASK);
+      counted += __builtin_popcount(bank.processReadings(frame, s.ts[f], m));
+    }
+    return counted;
+  });
+}
+
+static void benchThresholds() {
+  const uint32_t calls = 1000000;
+  runBench("calculateThresholds(Lane&)", calls, -1, [&]() {
+    Lane lane;
+    for (uint32_t i = 0; i < calls; i++) {
+      calculateThresholds(lane, (uint16_t)(200 + (i & 255)),
+                          DETECTION_DELTA_MM, CLEAR_HYSTERESIS_MM);
+      sink = lane.clearThresh_mm;
+    }
+    return 0L;
+  });
+  runBench("LaneBank<16>::calculateThresholds", calls, -1, [&]() {
+    static LaneBank<16> bank;
+    for (uint32_t i = 0; i < calls; i++) {
+      bank.calculateThresholds((uint8_t)(i & 15), (uint16_t)(200 + (i & 255)),
+                               DETECTION_DELTA_MM, CLEAR_HYSTERESIS_MM);
+    }
+    sink = bank.clearThresh_mm[rng() & 15];
+    return 0L;
+  });
+}
+
+static void benchHistogram() {
+  const uint32_t calls = 1000000;
+  runBench("Histogram::record", calls, -1, [&]() {
+    static Histogram h;
+    h.reset();
+    uint32_t v = 1;
+    for (uint32_t i = 0; i < calls; i++) {
+      v = v * 1103515245u + 12345u;
+      h.record(v >> 14);
+    }
+    sink = h.percentile(99);
+    return 0L;
+  });
+}
+
+// Recorded stream: readings are replayed one at a time in file order.
+static void benchRecorded(const std::vector<Sample>& samples, uint8_t lanes) {
+  // Reference count from the Lane path; the other paths must agree.
+  std::vector<Lane> ref(lanes);
+  for (Lane& l : ref) initLane(l);
+  long expected = 0;
+  for (const Sample& s : samples) {
+    expected += processLaneReading(ref[s.lane], s.dist, s.ts, LOCKOUT_MS);
+  }
+
+  runBench("recorded: processLaneReading", samples.size(), expected, [&]() {
+    std::vector<Lane> l(lanes);
+    for (Lane& x : l) initLane(x);
+    long counted = 0;
+    for (const Sample& s : samples) {
+      counted += processLaneReading(l[s.lane], s.dist, s.ts, LOCKOUT_MS);
+    }
+    return counted;
+  });
+  runBench("recorded: LaneBank<32>::process", samples.size(), expected, [&]() {
+    static LaneBank<32> bank;
+    initBank(bank);
+    long counted = 0;
+    for (const Sample& s : samples) counted += bank.process(s.lane, s.dist, s.ts);
+    return counted;
+  });
+}
+
+// ═══════════════════════════════════════════════════════════════════════════
+//  SELF-CHECKS  (correctness of helpers the timed paths don't exercise)
+// ═══════════════════════════════════════════════════════════════════════════
+
+static void check(bool ok, const char* what) {
+  std::printf("%-44s %s\n", what, ok ? "ok" : "FAILED");
+  if (!ok) failures++;
+}
+
+// Save → EEPROM bytes → load, with one lane that was offline at save time
+// (no baseline): the image must stay valid and only that lane cold-starts.
+static void checkStoredConfig() {
+  StoredConfig cfg;
+  std::memset(&cfg, 0, sizeof(cfg));
+  const uint8_t offline = FC_NUM_LANES > 1 ? 1 : 0;
+  for (uint8_t i = 0; i < FC_NUM_LANES; i++) {
+    StoredLane& l = cfg.lane[i];
+    l.wiring = defaultLaneWiring(i);
+    if (i == offline) continue;          // as saveConfig() writes a dead lane
+    l.baseline_mm = BASELINE_MM;
+    l.delta_mm    = DETECTION_DELTA_MM;
+    l.hyst_mm     = CLEAR_HYSTERESIS_MM;
+    l.calibrated  = 1;
+  }
+  sealConfig(cfg, FC_WIRING_MUX);
+
+  uint8_t eeprom[sizeof(StoredConfig)];
+  std::memcpy(eeprom, &cfg, sizeof(cfg));
+  StoredConfig back;
+  std::memcpy(&back, eeprom, sizeof(back));
+  const uint8_t muxes = laneMuxCount(FC_NUM_LANES);
+  check(configValid(back, FC_WIRING_MUX, muxes), "stored config: valid with an offline lane");
+  check(uncalibratedLanes(back) == 1u << offline,  "stored config: only that lane cold-starts");
+
+  back.lane[0].delta_mm = back.lane[0].baseline_mm;   // calibrated but bogus
+  sealConfig(back, FC_WIRING_MUX);
+  check(!configValid(back, FC_WIRING_MUX, muxes), "stored config: bad thresholds rejected");
+}
+
+// A count captured just before a reset's begin() (as lastSampleMs / IRQ
+// stamps can be) lands in bin 0 and keeps the rest of the history.
+static void checkCountBins() {
+  static CountBins<4, 64> bins;
+  const uint32_t origin = 100000;
+  bins.begin(origin, 100);
+  bins.add(1, origin - 5);               // stamped before begin()
+  check(bins.newest() == 0,                      "count bins: early stamp keeps the head");
+  bins.add(0, origin + 250);
+  check(bins.at(0, 1) == 1 && bins.at(2, 0) == 1, "count bins: early stamp folds into bin 0");
+
+  bins.begin(5, 100);                    // also across a millis() wrap
+  bins.add(2, 0xFFFFFFF0u);
+  check(bins.newest() == 0 && bins.at(0, 2) == 1, "count bins: wrapped early stamp in bin 0");
+}
+
+// ═══════════════════════════════════════════════════════════════════════════
+//  MAIN
+// ═══════════════════════════════════════════════════════════════════════════
+
+int main(int argc, char** argv) {
+  std::printf("fuel_counter bench — %u frames/lane, %lu ms sample period\n\n",
+              (unsigned)SYNTH_FRAMES, (unsigned long)SAMPLE_PERIOD_MS);
+
+  FrameStream s4  = makeSynthetic(4,  SYNTH_FRAMES);
+  FrameStream s8  = makeSynthetic(8,  SYNTH_FRAMES);
+  FrameStream s16 = makeSynthetic(16, SYNTH_FRAMES);
+
+  benchLaneScalar(s4);
+  benchBankBatch<4>(s4);
+  benchBankBatch<4>(s4, OPT_ADAPT);
+  benchBankBatch<4>(makeTouching(4, SYNTH_FRAMES), OPT_ALL, " touching");
+  benchBankBatch<4>(makeDrifting(4, SYNTH_FRAMES), OPT_ALL, " drifting");
+  benchBankSingle<4>(s4);
+  benchBankFiltered<4>(s4, "clean");
+  benchBankFiltered<4>(addSpikes(s4, 40), "spiky");
+  benchLaneScalar(s8);
+  benchBankBatch<8>(s8);
+  benchLaneScalar(s16);
+  benchBankBatch<16>(s16);
+  benchBankSingle<16>(s16);
+  benchThresholds();
+  benchHistogram();
+  std::printf("\n");
+  checkStoredConfig();
+  checkCountBins();
+
+  if (argc > 1) {
+    std::vector<Sample> samples;
+    uint8_t lanes = 0;
+    if (!loadCsv(argv[1], samples, lanes) || samples.empty()) {
+      std::fprintf(stderr, "cannot read stream %s\n", argv[1]);
+      return 2;
+    }
+    std::printf("\n%s: %zu samples, %u lanes\n", argv[1], samples.size(), lanes);
+    benchRecorded(samples, lanes);
+  }
+
+  if (failures) {
+    std::printf("\n%d benchmark(s) miscounted or check(s) failed\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,84 @@
+/*******************************************************************************
+ * calibration.h — Robust per-lane baseline estimation (median / MAD)
+ *
+ * Collects S empty-lane readings for one lane, then takes the median,
+ * drops readings more than ~3σ from it (|x − median| > 4.5·MAD, MAD
+ * floored at 1 mm) and averages the rest.  A stray reflection or a hand
+ * in the beam no longer drags the baseline the way a plain mean does.
+ * Pure C++, header-only, fixed memory (2·S bytes per lane).
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+
+static const uint16_t FC_CALIB_MAX_VALID_MM = 8000;   // VL53L0X "out of range"
+
+template <uint8_t S>
+class LaneCalibrator {
+  static_assert(S >= 3, "need at least 3 calibration samples");
+
+public:
+  static const uint8_t SAMPLES = S;
+
+  // Start a new window; the first reading after this is discarded (it may
+  // have been ranged before the lane was cleared / reconfigured).
+  void begin() { n_ = 0; skip_ = true; }
+
+  /**
+   * Offer one reading.  Invalid readings (0 or out of range) are ignored.
+   * @return true once the window is full
+   */
+  bool add(uint16_t d) {
+    if (skip_) { skip_ = false; return false; }
+    if (d == 0 || d >= FC_CALIB_MAX_VALID_MM) return n_ >= S;
+    if (n_ < S) buf_[n_++] = d;
+    return n_ >= S;
+  }
+
+  bool    full()  const { return n_ >= S; }
+  uint8_t count() const { return n_; }
+
+  /**
+   * Robust baseline from the collected readings.
+   * @param baseline_mm  mean of the inliers
+   * @param mad_mm       median absolute deviation (noise estimate)
+   * @param inliers      readings that were kept
+   * @return false if fewer than half the window survived
+   */
+  bool result(uint16_t& baseline_mm, uint16_t& mad_mm, uint8_t& inliers) const {
+    if (n_ == 0) return false;
+    uint16_t v[S];
+    for (uint8_t i = 0; i < n_; i++) v[i] = buf_[i];
+    uint16_t med = median(v, n_);
+
+    for (uint8_t i = 0; i < n_; i++) v[i] = buf_[i] > med ? buf_[i] - med : med - buf_[i];
+    uint16_t mad = median(v, n_);
+    mad_mm = mad;
+    if (mad < 1) mad = 1;
+
+    uint32_t sum = 0;
+    inliers = 0;
+    for (uint8_t i = 0; i < n_; i++) {
+      uint16_t dev = buf_[i] > med ? buf_[i] - med : med - buf_[i];
+      if ((uint32_t)dev * 2 <= (uint32_t)mad * 9) { sum += buf_[i]; inliers++; }
+    }
+    if (inliers * 2 < n_) return false;
+    baseline_mm = (uint16_t)((sum + inliers / 2) / inliers);
+    return true;
+  }
+
+private:
+  // Median by insertion sort (S is small); reorders v.
+  static uint16_t median(uint16_t* v, uint8_t n) {
+    for (uint8_t i = 1; i < n; i++) {
+      uint16_t x = v[i];
+      uint8_t  j = i;
+      while (j > 0 && v[j - 1] > x) { v[j] = v[j - 1]; j--; }
+      v[j] = x;
+    }
+    return (n & 1) ? v[n / 2] : (uint16_t)((v[n / 2 - 1] + v[n / 2]) / 2);
+  }
+
+  uint16_t buf_[S];
+  uint8_t  n_    = 0;
+  bool     skip_ = true;
+};
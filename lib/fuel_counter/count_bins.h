@@ -0,0 +1,93 @@
+/*******************************************************************************
+ * count_bins.h — Per-lane counts in a fixed ring of time bins
+ *
+ * Bin k covers [origin + k·binMs, origin + (k+1)·binMs).  Bin numbers are
+ * absolute since begin(); the ring keeps the newest BINS of them, so a
+ * 100 ms bin × 1800 ring holds a full 3-minute match.  add() is O(1)
+ * (plus clearing the bins skipped over since the last call); each cell is
+ * a saturating u8, so memory is exactly BINS × LANES bytes.
+ *
+ * Binary export (GET /bins?fmt=bin), little-endian:
+ *
+ *   0    u8    magic      0xFC
+ *   1    u8    type       FC_COUNT_BINS_TYPE
+ *   2    u8    nLanes
+ *   3    u8    reserved   0
+ *   4    u32   firstBin   number of the first bin that follows
+ *   8    u32   origin     millis() at the start of bin 0
+ *   12   u16   binMs
+ *   14   u16   nBins
+ *   16   u8[nBins][nLanes]   counts, oldest bin first (the last is partial)
+ *
+ * Pure C++, header-only.
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+static const uint8_t FC_COUNT_BINS_TYPE         = 5;  // after the WS frame types
+static const size_t  FC_COUNT_BINS_HEADER_BYTES = 16;
+
+template <uint8_t LANES, uint16_t BINS>
+class CountBins {
+public:
+  // Clear the history and start bin 0 at now_ms.
+  void begin(uint32_t now_ms, uint16_t bin_ms) {
+    memset(bins_, 0, sizeof(bins_));
+    origin_ = now_ms;
+    binMs_  = bin_ms ? bin_ms : 1;
+    head_   = 0;
+    filled_ = 1;
+  }
+
+  // A stamp from before begin() (a capture time older than a reset) is
+  // folded into bin 0 rather than read as a wrapped, far-future bin.
+  void add(uint8_t lane, uint32_t now_ms, uint8_t n = 1) {
+    if (lane >= LANES) return;
+    if ((int32_t)(now_ms - origin_) < 0) now_ms = origin_;
+    advance(now_ms);
+    uint8_t& cell = bins_[head_ % BINS][lane];
+    cell = (uint16_t)cell + n > 255 ? 255 : (uint8_t)(cell + n);
+  }
+
+  // Roll the ring forward to now_ms, zeroing the bins that start on the way.
+  void advance(uint32_t now_ms) {
+    if ((int32_t)(now_ms - origin_) < 0) now_ms = origin_;
+    uint32_t target = (now_ms - origin_) / binMs_;
+    if (target <= head_) return;
+    uint32_t steps = target - head_;
+    if (steps >= BINS) {
+      memset(bins_, 0, sizeof(bins_));
+    } else {
+      for (uint32_t k = 1; k <= steps; k++) {
+        memset(bins_[(head_ + k) % BINS], 0, LANES);
+      }
+    }
+    head_   = target;
+    filled_ = filled_ + steps >= BINS ? BINS : filled_ + steps;
+  }
+
+  uint32_t newest()  const { return head_; }                // current (partial) bin
+  uint32_t oldest()  const { return head_ + 1 - filled_; }
+  uint32_t origin()  const { return origin_; }
+  uint16_t binMs()   const { return binMs_; }
+
+  // Count for one bin, 0 outside the retained window.
+  uint8_t at(uint32_t bin, uint8_t lane) const {
+    if (bin < oldest() || bin > head_ || lane >= LANES) return 0;
+    return bins_[bin % BINS][lane];
+  }
+
+  // All lanes of one retained bin (LANES bytes), or nullptr.
+  const uint8_t* row(uint32_t bin) const {
+    if (bin < oldest() || bin > head_) return nullptr;
+    return bins_[bin % BINS];
+  }
+
+private:
+  uint8_t  bins_[BINS][LANES] = {};
+  uint32_t origin_ = 0;
+  uint16_t binMs_  = 1;
+  uint32_t head_   = 0;
+  uint32_t filled_ = 1;
+};
@@ -0,0 +1,68 @@
+/*******************************************************************************
+ * count_log.h — Sequenced ring of recent count events
+ *
+ * Every counted ball gets a monotonically increasing sequence number.  The
+ * last CAP events are retained so a reconnecting client can ask for
+ * "everything after seq N" instead of a full snapshot.  Pure C++,
+ * header-only, fixed memory (5 bytes per slot).
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+
+template <uint16_t CAP>
+class CountLog {
+  static_assert(CAP >= 2 && (CAP & (CAP - 1)) == 0,
+                "CountLog capacity must be a power of two");
+
+public:
+  static const uint16_t CAPACITY = CAP;
+
+  // Record one count; returns its sequence number (first event is 1).
+  uint32_t append(uint8_t lane, uint32_t ts_ms) {
+    uint32_t seq = nextSeq_++;
+    uint16_t idx = seq & (CAP - 1);
+    lane_[idx] = lane;
+    ts_[idx]   = ts_ms;
+    if (seq - first_ >= CAP) first_ = seq - CAP + 1;   // oldest overwritten
+    return seq;
+  }
+
+  // Sequence number of the newest event (0 before the first one).
+  uint32_t lastSeq()  const { return nextSeq_ - 1; }
+
+  // Sequence number of the oldest retained event (lastSeq()+1 when empty).
+  uint32_t firstSeq() const { return first_; }
+
+  /**
+   * True if every event after afterSeq is still in the ring, i.e. a client
+   * that has seen up to afterSeq can be brought current from the log alone.
+   */
+  bool covers(uint32_t afterSeq) const {
+    return afterSeq + 1 >= first_ && afterSeq <= lastSeq();
+  }
+
+  // Fetch a retained event; returns false if seq is outside the ring.
+  bool at(uint32_t seq, uint8_t& lane, uint32_t& ts_ms) const {
+    if (seq < first_ || seq > lastSeq()) return false;
+    uint16_t idx = seq & (CAP - 1);
+    lane  = lane_[idx];
+    ts_ms = ts_[idx];
+    return true;
+  }
+
+  /**
+   * Drop all events and burn one sequence number, so no earlier afterSeq
+   * is covered any more (used when counts are reset: old deltas no longer
+   * apply and clients must take a snapshot).
+   */
+  void clear() {
+    nextSeq_++;
+    first_ = nextSeq_;
+  }
+
+private:
+  uint32_t ts_[CAP];
+  uint8_t  lane_[CAP];
+  uint32_t nextSeq_ = 1;
+  uint32_t first_   = 1;
+};
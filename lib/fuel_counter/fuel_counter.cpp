@@ -10,32 +10,9 @@ bool processLaneReading(Lane& lane, uint16_t distance_mm,
 
   lane.lastDistance_mm = distance_mm;
 
-  switch (lane.state) {
-
-    case LaneState::IDLE:
-      if (distance_mm < lane.threshold_mm) {
-        lane.state = LaneState::BALL_PRESENT;
-      }
-      break;
-
-    case LaneState::BALL_PRESENT:
-      // Ball has fully passed when distance rises above the clear threshold
-      if (distance_mm > lane.clearThresh_mm) {
-        lane.count++;
-        lane.state        = LaneState::LOCKOUT;
-        lane.lockoutStart = now_ms;
-        return true;   // <— ball counted
-      }
-      break;
-
-    case LaneState::LOCKOUT:
-      if (now_ms - lane.lockoutStart >= lockout_ms) {
-        lane.state = LaneState::IDLE;
-      }
-      break;
-  }
-
-  return false;
+  return laneStep(lane.state, lane.lockoutStart, lane.presentStart, lane.count,
+                  lane.threshold_mm, lane.clearThresh_mm,
+                  distance_mm, now_ms, lockout_ms);
 }
 
 void calculateThresholds(Lane& lane, uint16_t baseline_mm,
@@ -7,7 +7,12 @@
 #include <stdint.h>
 
 // ── Number of lanes ─────────────────────────────────────────────────────
-static const uint8_t FC_NUM_LANES = 4;
+// Override per build with -DFC_LANE_COUNT=8 (up to 32; one TCA9548A per 8).
+#ifndef FC_LANE_COUNT
+#define FC_LANE_COUNT 4
+#endif
+static const uint8_t FC_NUM_LANES = FC_LANE_COUNT;
+static_assert(FC_NUM_LANES >= 1 && FC_NUM_LANES <= 32, "FC_LANE_COUNT must be 1..32");
 
 // ── Lane state machine ──────────────────────────────────────────────────
 enum class LaneState : uint8_t { IDLE, BALL_PRESENT, LOCKOUT };
@@ -19,12 +24,49 @@ struct Lane {
   uint32_t  count           = 0;
   LaneState state           = LaneState::IDLE;
   uint32_t  lockoutStart    = 0;
+  uint32_t  presentStart    = 0;       // when the current ball entered the beam
   bool      sensorOk        = false;   // false = sensor init failed / offline
   uint16_t  lastDistance_mm = 0;       // latest raw reading
 };
 
 // ── Pure-logic functions (hardware-independent) ─────────────────────────
 
+/**
+ * One step of the lane state machine on unpacked state.  Shared by the
+ * Lane (array-of-structs) and LaneBank (structure-of-arrays) front ends so
+ * both count identically.
+ * @return true if a ball was counted on this step
+ */
+inline bool laneStep(LaneState& state, uint32_t& lockoutStart,
+                     uint32_t& presentStart, uint32_t& count,
+                     uint16_t threshold_mm, uint16_t clearThresh_mm,
+                     uint16_t distance_mm, uint32_t now_ms, uint32_t lockout_ms)
+{
+  switch (state) {
+    case LaneState::IDLE:
+      if (distance_mm < threshold_mm) {
+        state        = LaneState::BALL_PRESENT;
+        presentStart = now_ms;
+      }
+      return false;
+
+    case LaneState::BALL_PRESENT:
+      // Ball has fully passed when distance rises above the clear threshold
+      if (distance_mm > clearThresh_mm) {
+        count++;
+        state        = LaneState::LOCKOUT;
+        lockoutStart = now_ms;
+        return true;   // <— ball counted
+      }
+      return false;
+
+    case LaneState::LOCKOUT:
+      if (now_ms - lockoutStart >= lockout_ms) state = LaneState::IDLE;
+      return false;
+  }
+  return false;
+}
+
 /**
  * Process a single ToF distance reading for one lane.
  *
@@ -53,3 +95,312 @@ void calculateThresholds(Lane& lane, uint16_t baseline_mm,
  * Reset all lane counts and states; zero the total.
  */
 void resetLanes(Lane lanes[], uint8_t num_lanes, uint32_t& totalCount);
+
+// ── Structure-of-arrays lane storage ────────────────────────────────────
+
+/**
+ * Fixed-size bank of N lanes stored as parallel arrays, so a batch update
+ * walks contiguous memory and the lane loop has a compile-time trip count
+ * the compiler can unroll.  Sensor health is a bitmask (bit i = lane i).
+ */
+template <uint8_t N>
+struct LaneBank {
+  static_assert(N >= 1 && N <= 32, "LaneBank supports 1..32 lanes");
+  static const uint8_t  SIZE     = N;
+  static const uint32_t ALL_MASK = (N == 32) ? 0xFFFFFFFFu : ((1u << N) - 1u);
+
+  uint16_t  baseline_mm[N]     = {};   // calibrated empty-lane distance
+  uint16_t  threshold_mm[N]    = {};   // ball present below this
+  uint16_t  clearThresh_mm[N]  = {};   // ball cleared above this
+  uint32_t  count[N]           = {};
+  LaneState state[N]           = {};
+  uint32_t  lockoutStart[N]    = {};
+  uint32_t  lockout_ms[N]      = {};   // post-count dead time per lane
+  uint32_t  presentStart[N]    = {};   // when the current ball entered the beam
+  uint32_t  dwellQ4_ms[N]      = {};   // smoothed beam-blocked time, ms × 16
+  uint16_t  lastDistance_mm[N] = {};   // latest raw reading
+  uint32_t  okMask             = 0;    // bit i set = lane i sensor online
+
+  // Adaptive lockout (off while lockoutDwellPct == 0): after each count the
+  // lane's lockout becomes lockoutDwellPct % of its smoothed dwell time,
+  // clamped to [lockoutMin_ms, lockoutMax_ms].
+  uint8_t   lockoutDwellPct    = 0;
+  uint16_t  lockoutMin_ms      = 0;
+  uint16_t  lockoutMax_ms      = 0;
+  uint32_t  fixedLockoutMask   = 0;    // bit i = lane i's lockout set by hand
+
+  // Multi-ball detection (off while maxBallsPerPass <= 1).  While a lane is
+  // BALL_PRESENT its distance is tracked for separate dips — a rise of at
+  // least dipRise_mm followed by a fall of as much, without clearing — and
+  // its occupancy is compared with the lane's single-ball dwell.  The larger
+  // of the two estimates is counted when the lane clears.
+  uint8_t   maxBallsPerPass    = 1;
+  uint16_t  dipRise_mm         = 0;
+  uint16_t  dipLow_mm[N]       = {};   // lowest point of the current dip
+  uint16_t  dipPeak_mm[N]      = {};   // highest point since that dip
+  uint8_t   dips[N]            = {};   // dips seen in the current pass
+  bool      dipRising[N]       = {};
+  uint8_t   lastBalls[N]       = {};   // balls counted by the lane's last pass
+  uint8_t   lastConfidence[N]  = {};   // 0–100 confidence in lastBalls
+  uint32_t  multiPasses[N]     = {};   // passes counted as more than one ball
+
+  // Baseline drift tracking (off while driftShift == 0).  Readings taken
+  // while IDLE, at or above clearThresh_mm and within driftWindow_mm of the
+  // current baseline feed a fixed-point EMA (α = 1/2^driftShift).  Each
+  // sample may move it at most driftStepQ8 / 256 mm, and it never strays
+  // more than driftLimit_mm from the calibrated value.
+  uint8_t   driftShift         = 0;
+  uint16_t  driftStepQ8        = 0;
+  uint16_t  driftWindow_mm     = 0;
+  uint16_t  driftLimit_mm      = 0;
+  uint32_t  baselineQ8[N]      = {};   // tracked baseline, mm × 256
+  uint16_t  calBaseline_mm[N]  = {};   // last calibrated baseline
+  uint16_t  delta_mm[N]        = {};   // detection delta per lane
+  uint16_t  hyst_mm[N]         = {};   // clear hysteresis per lane
+
+  bool sensorOk(uint8_t i) const { return (okMask >> i) & 1u; }
+  void setSensorOk(uint8_t i, bool ok) {
+    okMask = ok ? (okMask | (1u << i)) : (okMask & ~(1u << i));
+  }
+
+  /**
+   * Run one reading per lane through the state machine.
+   *
+   * @param dist     N distance readings, indexed by lane
+   * @param now_ms   Timestamp shared by the batch (millis)
+   * @param mask     Lanes whose dist[] entry is fresh (others untouched)
+   * @return bitmask of lanes that counted a ball on this call
+   */
+  uint32_t processReadings(const uint16_t* dist, uint32_t now_ms,
+                           uint32_t mask = ALL_MASK)
+  {
+    const uint32_t active = mask & okMask;
+    uint32_t counted = 0;
+    for (uint8_t i = 0; i < N; i++) {
+      if (!((active >> i) & 1u)) continue;
+      if (step(i, dist[i], now_ms)) counted |= 1u << i;
+    }
+    return counted;
+  }
+
+  /**
+   * As above, but every lane with its own capture time (ts_ms indexed by
+   * lane), so lockout and dwell follow when each sample was taken rather
+   * than when the batch got processed.
+   */
+  uint32_t processReadings(const uint16_t* dist, const uint32_t* ts_ms, uint32_t mask)
+  {
+    const uint32_t active = mask & okMask;
+    uint32_t counted = 0;
+    for (uint8_t i = 0; i < N; i++) {
+      if (!((active >> i) & 1u)) continue;
+      if (step(i, dist[i], ts_ms[i])) counted |= 1u << i;
+    }
+    return counted;
+  }
+
+  /**
+   * Single-lane form of processReadings().  A count may be more than one
+   * ball when multi-ball detection is on: see lastBalls[i].
+   */
+  bool process(uint8_t i, uint16_t distance_mm, uint32_t now_ms) {
+    if (!sensorOk(i)) return false;
+    return step(i, distance_mm, now_ms);
+  }
+
+  bool step(uint8_t i, uint16_t d, uint32_t now_ms) {
+    lastDistance_mm[i] = d;
+    const LaneState before = state[i];
+    if (before == LaneState::BALL_PRESENT) trackDip(i, d);
+    if (!laneStep(state[i], lockoutStart[i], presentStart[i], count[i],
+                  threshold_mm[i], clearThresh_mm[i],
+                  d, now_ms, lockout_ms[i])) {
+      if (before == LaneState::IDLE) {
+        if (state[i] == LaneState::BALL_PRESENT) {
+          dipLow_mm[i] = d;
+          dips[i]      = 1;
+          dipRising[i] = false;
+        } else if (driftShift && d >= clearThresh_mm[i]) {
+          trackBaseline(i, d);
+        }
+      }
+      return false;
+    }
+    noteTransit(i, now_ms);
+    return true;
+  }
+
+  // Nudge lane i's baseline toward an empty-lane reading (see driftShift).
+  void trackBaseline(uint8_t i, uint16_t d) {
+    int32_t err = (int32_t)d - (int32_t)baseline_mm[i];
+    if (err > (int32_t)driftWindow_mm || -err > (int32_t)driftWindow_mm) return;
+
+    int32_t stepQ8 = (((int32_t)d << 8) - (int32_t)baselineQ8[i]) >> driftShift;
+    if (stepQ8 >  (int32_t)driftStepQ8) stepQ8 =  driftStepQ8;
+    if (stepQ8 < -(int32_t)driftStepQ8) stepQ8 = -(int32_t)driftStepQ8;
+    int32_t q8 = (int32_t)baselineQ8[i] + stepQ8;
+    int32_t lo = ((int32_t)calBaseline_mm[i] - driftLimit_mm) << 8;
+    int32_t hi = ((int32_t)calBaseline_mm[i] + driftLimit_mm) << 8;
+    if (q8 < lo) q8 = lo;
+    if (q8 > hi) q8 = hi;
+    baselineQ8[i] = (uint32_t)q8;
+
+    uint16_t mm = (uint16_t)((baselineQ8[i] + 128) >> 8);
+    if (mm != baseline_mm[i]) applyBaseline(i, mm);
+  }
+
+  // Follow the dip shape of a BALL_PRESENT lane (see dipRise_mm).
+  void trackDip(uint8_t i, uint16_t d) {
+    if (!dipRising[i]) {
+      if (d < dipLow_mm[i]) dipLow_mm[i] = d;
+      else if (d >= dipLow_mm[i] + dipRise_mm) { dipRising[i] = true; dipPeak_mm[i] = d; }
+    } else {
+      if (d > dipPeak_mm[i]) dipPeak_mm[i] = d;
+      else if (d + dipRise_mm <= dipPeak_mm[i]) {
+        if (dips[i] < 255) dips[i]++;
+        dipRising[i] = false;
+        dipLow_mm[i] = d;
+      }
+    }
+  }
+
+  /**
+   * Settle a pass that just cleared: decide how many balls it held (shape
+   * and occupancy), add the extra counts, fold the per-ball dwell into the
+   * lane's average (EMA, α = 1/4) and, if adaptive lockout is enabled,
+   * rescale the lane's lockout from it.  Fast balls get a short dead time
+   * so tight streams aren't dropped; slow rollers get a longer one.
+   */
+  void noteTransit(uint8_t i, uint32_t now_ms) {
+    uint32_t dwellQ4 = (now_ms - presentStart[i]) << 4;
+    uint8_t  balls = 1, conf = 100;
+    if (maxBallsPerPass > 1) {
+      uint8_t byDips = dips[i] < maxBallsPerPass ? dips[i] : maxBallsPerPass;
+      // Occupancy in single-ball dwells; needs ≥ 1.75× for a second ball so
+      // ordinary speed spread doesn't split slow rollers
+      uint8_t byTime = 0;
+      if (dwellQ4_ms[i]) {
+        uint32_t q = (dwellQ4 * 4 / dwellQ4_ms[i] + 1) / 4;
+        byTime = q < 1 ? 1 : (q > maxBallsPerPass ? maxBallsPerPass : (uint8_t)q);
+      }
+      balls = byDips > byTime ? byDips : byTime;
+      if (balls > 1) {
+        conf = (byDips == byTime) ? 90 : 60;    // both cues agree vs one
+        count[i] += balls - 1;
+        multiPasses[i]++;
+      }
+    }
+    lastBalls[i]      = balls;
+    lastConfidence[i] = conf;
+
+    dwellQ4 /= balls;
+    dwellQ4_ms[i] = dwellQ4_ms[i] ? dwellQ4_ms[i] - (dwellQ4_ms[i] >> 2) + (dwellQ4 >> 2)
+                                  : dwellQ4;
+    if (!lockoutDwellPct || ((fixedLockoutMask >> i) & 1u)) return;
+    uint32_t lo = ((dwellQ4_ms[i] >> 4) * lockoutDwellPct) / 100;
+    if (lo < lockoutMin_ms) lo = lockoutMin_ms;
+    if (lo > lockoutMax_ms) lo = lockoutMax_ms;
+    lockout_ms[i] = lo;
+  }
+
+  // Smoothed dwell time of lane i (ms); 0 until its first count.
+  uint32_t dwell(uint8_t i) const { return dwellQ4_ms[i] >> 4; }
+
+  /**
+   * Ball speed through lane i from its dwell time, in mm/s (0 if unknown).
+   * The beam is blocked for roughly one ball diameter of travel.
+   */
+  uint32_t speed(uint8_t i, uint16_t ballDiameter_mm) const {
+    return dwellQ4_ms[i] ? ((uint32_t)ballDiameter_mm * 16000u) / dwellQ4_ms[i] : 0;
+  }
+
+  /**
+   * Enable multi-ball detection: up to maxBalls per pass (≤ 1 disables it),
+   * with dipRise_mm of rise-and-fall separating two dips.
+   */
+  void setMultiBall(uint8_t maxBalls, uint16_t rise_mm) {
+    maxBallsPerPass = maxBalls ? maxBalls : 1;
+    dipRise_mm      = rise_mm;
+  }
+
+  /**
+   * Enable adaptive lockout (pct = 0 disables it and keeps lockout_ms).
+   * Until a lane has counted a ball it keeps its current lockout_ms.
+   */
+  void setAdaptiveLockout(uint8_t pct, uint16_t min_ms, uint16_t max_ms) {
+    lockoutDwellPct = pct;
+    lockoutMin_ms   = min_ms;
+    lockoutMax_ms   = max_ms;
+  }
+
+  /**
+   * Same rule as calculateThresholds(Lane&, …).  Also records baseline as
+   * the lane's calibrated value (the centre of the drift limit) and keeps
+   * delta / hysteresis so drift tracking can re-derive the thresholds.
+   */
+  void calculateThresholds(uint8_t i, uint16_t baseline,
+                           uint16_t detection_delta_mm,
+                           uint16_t clear_hysteresis_mm)
+  {
+    delta_mm[i]       = detection_delta_mm;
+    hyst_mm[i]        = clear_hysteresis_mm;
+    calBaseline_mm[i] = baseline;
+    baselineQ8[i]     = (uint32_t)baseline << 8;
+    applyBaseline(i, baseline);
+  }
+
+  // Change lane i's detection delta / hysteresis around its live baseline.
+  void setDetection(uint8_t i, uint16_t detection_delta_mm,
+                    uint16_t clear_hysteresis_mm)
+  {
+    delta_mm[i] = detection_delta_mm;
+    hyst_mm[i]  = clear_hysteresis_mm;
+    applyBaseline(i, baseline_mm[i]);
+  }
+
+  // Move lane i's baseline (and thresholds) without re-centring drift limits.
+  void applyBaseline(uint8_t i, uint16_t baseline) {
+    baseline_mm[i]    = baseline;
+    threshold_mm[i]   = baseline - delta_mm[i];
+    clearThresh_mm[i] = threshold_mm[i] + hyst_mm[i];
+  }
+
+  /**
+   * Enable baseline drift tracking (shift = 0 disables it).
+   * @param shift      EMA weight 1/2^shift per qualifying reading
+   * @param stepQ8     most a single reading may move the baseline (mm/256)
+   * @param window_mm  ignore readings further than this from the baseline
+   * @param limit_mm   never drift further than this from calibration
+   */
+  void setDriftTracking(uint8_t shift, uint16_t stepQ8,
+                        uint16_t window_mm, uint16_t limit_mm)
+  {
+    driftShift     = shift;
+    driftStepQ8    = stepQ8;
+    driftWindow_mm = window_mm;
+    driftLimit_mm  = limit_mm;
+  }
+
+  void setLockout(uint32_t ms) {
+    for (uint8_t i = 0; i < N; i++) lockout_ms[i] = ms;
+  }
+
+  // Pin lane i's lockout to ms, exempt from adaptive lockout; ms = 0 hands
+  // it back (adaptation takes over again from the lane's next count).
+  void setFixedLockout(uint8_t i, uint32_t ms) {
+    if (ms) { lockout_ms[i] = ms; fixedLockoutMask |= 1u << i; }
+    else    fixedLockoutMask &= ~(1u << i);
+  }
+
+  bool lockoutFixed(uint8_t i) const { return (fixedLockoutMask >> i) & 1u; }
+
+  // Reset all lane counts and states; zero the total.  Dwell averages and
+  // adapted lockouts are kept, since they describe the lane, not the match.
+  void reset(uint32_t& totalCount) {
+    for (uint8_t i = 0; i < N; i++) {
+      count[i] = 0;
+      state[i] = LaneState::IDLE;
+    }
+    totalCount = 0;
+  }
+};
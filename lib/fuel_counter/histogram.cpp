@@ -0,0 +1,58 @@
+/*******************************************************************************
+ * histogram.cpp — Fixed-bucket latency histogram
+ ******************************************************************************/
+#include "histogram.h"
+
+static uint8_t msbIndex(uint32_t v) {
+  uint8_t n = 0;
+  while (v >>= 1) n++;
+  return n;
+}
+
+uint8_t Histogram::bucketOf(uint32_t value) {
+  if (value < 4) return (uint8_t)value;
+  uint8_t msb = msbIndex(value);                  // ≥ 2
+  uint8_t sub = (value >> (msb - 1)) & 1u;        // upper or lower half-octave
+  uint32_t idx = 4u + (uint32_t)(msb - 2) * 2u + sub;
+  return idx < BUCKETS ? (uint8_t)idx : (uint8_t)(BUCKETS - 1);
+}
+
+uint32_t Histogram::bucketUpper(uint8_t bucket) {
+  if (bucket < 4) return bucket;
+  if (bucket >= BUCKETS - 1) return 0xFFFFFFFFu;
+  uint8_t msb = (uint8_t)((bucket - 4) / 2 + 2);
+  uint8_t sub = (uint8_t)((bucket - 4) & 1u);
+  uint32_t lower = (uint32_t)(2u + sub) << (msb - 1);
+  return lower + (1u << (msb - 1)) - 1u;
+}
+
+void Histogram::record(uint32_t value) {
+  bins_[bucketOf(value)]++;
+  count_++;
+  if (value < min_) min_ = value;
+  if (value > max_) max_ = value;
+}
+
+void Histogram::reset() {
+  for (uint8_t i = 0; i < BUCKETS; i++) bins_[i] = 0;
+  count_ = 0;
+  min_   = 0xFFFFFFFFu;
+  max_   = 0;
+}
+
+uint32_t Histogram::percentile(uint8_t pct) const {
+  if (count_ == 0) return 0;
+  if (pct > 100) pct = 100;
+  // Rank of the sample we want (1-based, rounded up)
+  uint64_t rank = ((uint64_t)count_ * pct + 99) / 100;
+  if (rank == 0) rank = 1;
+  uint64_t seen = 0;
+  for (uint8_t i = 0; i < BUCKETS; i++) {
+    seen += bins_[i];
+    if (seen >= rank) {
+      uint32_t upper = bucketUpper(i);
+      return upper < max_ ? upper : max_;
+    }
+  }
+  return max_;
+}
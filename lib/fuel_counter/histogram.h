@@ -0,0 +1,38 @@
+/*******************************************************************************
+ * histogram.h — Fixed-bucket latency histogram (log2 with half-octave steps)
+ *
+ * Constant-time record(), fixed memory, no floating point.  Values 0–3 get
+ * exact buckets; above that each power of two is split in two, so any
+ * reported percentile is within ~25 % of the true value.  Buckets top out
+ * around 16.7 s (in µs), which is plenty for loop and network timings.
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+
+class Histogram {
+public:
+  static const uint8_t BUCKETS = 48;
+
+  void record(uint32_t value);
+  void reset();
+
+  uint32_t count() const { return count_; }
+  uint32_t min()   const { return count_ ? min_ : 0; }
+  uint32_t max()   const { return max_; }
+
+  /**
+   * Upper bound of the bucket holding the pct-th percentile (0–100),
+   * clamped to the observed max.  Returns 0 for an empty histogram.
+   */
+  uint32_t percentile(uint8_t pct) const;
+
+  // Bucket mapping, exposed for tests/benchmarks.
+  static uint8_t  bucketOf(uint32_t value);
+  static uint32_t bucketUpper(uint8_t bucket);
+
+private:
+  uint32_t bins_[BUCKETS] = {};
+  uint32_t count_ = 0;
+  uint32_t min_   = 0xFFFFFFFFu;
+  uint32_t max_   = 0;
+};
@@ -0,0 +1,87 @@
+/*******************************************************************************
+ * hub_link.cpp — Hub count datagram codec and aggregator table
+ ******************************************************************************/
+#include "hub_link.h"
+#include "ws_protocol.h"   // FC_WS_MAGIC, little-endian helpers
+
+size_t encodeHubCounts(uint8_t* out, size_t cap, const HubCounts& hdr,
+                       const uint32_t* counts)
+{
+  if (hdr.nLanes > FC_HUB_MAX_LANES) return 0;
+  size_t len = hubCountsMax(hdr.nLanes);
+  if (len > cap) return 0;
+  out[0] = FC_WS_MAGIC;
+  out[1] = FC_HUB_COUNTS_TYPE;
+  out[2] = hdr.nLanes;
+  out[3] = hdr.hubId;
+  putLe32(out + 4,  hdr.seq);
+  putLe32(out + 8,  hdr.ts_ms);
+  putLe32(out + 12, hdr.total);
+  putLe32(out + 16, hdr.okMask);
+  putLe16(out + 20, hdr.bootId);
+  putLe16(out + 22, 0);
+  for (uint8_t i = 0; i < hdr.nLanes; i++) putLe32(out + FC_HUB_HEADER_BYTES + 4u * i, counts[i]);
+  return len;
+}
+
+bool decodeHubCounts(const uint8_t* in, size_t len, HubCounts& hdr,
+                     uint32_t* counts)
+{
+  if (len < FC_HUB_HEADER_BYTES || in[0] != FC_WS_MAGIC || in[1] != FC_HUB_COUNTS_TYPE) {
+    return false;
+  }
+  hdr.nLanes = in[2];
+  hdr.hubId  = in[3];
+  if (hdr.nLanes > FC_HUB_MAX_LANES || hdr.hubId >= FC_MAX_HUBS ||
+      len < hubCountsMax(hdr.nLanes)) {
+    return false;
+  }
+  hdr.seq    = getLe32(in + 4);
+  hdr.ts_ms  = getLe32(in + 8);
+  hdr.total  = getLe32(in + 12);
+  hdr.okMask = getLe32(in + 16);
+  hdr.bootId = getLe16(in + 20);
+  for (uint8_t i = 0; i < hdr.nLanes; i++) counts[i] = getLe32(in + FC_HUB_HEADER_BYTES + 4u * i);
+  return true;
+}
+
+HubTable::Result HubTable::accept(const HubCounts& hdr, const uint32_t* counts,
+                                  uint32_t now_ms)
+{
+  HubEntry& h = hubs_[hdr.hubId];
+  bool restarted = !h.known || hdr.bootId != h.bootId;
+  if (!restarted && (int32_t)(hdr.seq - h.seq) <= 0) return OLD;   // dup / reordered
+  if (!restarted) h.lost += hdr.seq - h.seq - 1;
+
+  bool changed = restarted || h.total != hdr.total || h.okMask != hdr.okMask ||
+                 h.nLanes != hdr.nLanes;
+  for (uint8_t i = 0; i < hdr.nLanes && !changed; i++) changed = h.counts[i] != counts[i];
+
+  h.known    = true;
+  h.bootId   = hdr.bootId;
+  h.seq      = hdr.seq;
+  h.lastRxMs = now_ms;
+  h.rx++;
+  if (!changed) return SAME;
+  h.nLanes = hdr.nLanes;
+  h.total  = hdr.total;
+  h.okMask = hdr.okMask;
+  for (uint8_t i = 0; i < hdr.nLanes; i++) h.counts[i] = counts[i];
+  return CHANGED;
+}
+
+uint32_t HubTable::total(uint32_t now_ms, uint32_t timeout_ms) const {
+  uint32_t sum = 0;
+  for (uint8_t i = 0; i < FC_MAX_HUBS; i++) {
+    if (online(i, now_ms, timeout_ms)) sum += hubs_[i].total;
+  }
+  return sum;
+}
+
+uint8_t HubTable::onlineMask(uint32_t now_ms, uint32_t timeout_ms) const {
+  uint8_t mask = 0;
+  for (uint8_t i = 0; i < FC_MAX_HUBS; i++) {
+    if (online(i, now_ms, timeout_ms)) mask |= (uint8_t)(1u << i);
+  }
+  return mask;
+}
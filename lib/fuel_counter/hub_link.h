@@ -0,0 +1,97 @@
+/*******************************************************************************
+ * hub_link.h — Hub → aggregator count datagrams over UDP
+ *
+ * Each reporting hub sends its absolute counts whenever they change and as
+ * a heartbeat otherwise, so a lost datagram is repaired by the next one and
+ * the aggregator never has to ask for anything.  Sequence numbers drop
+ * duplicates and reordered stragglers; bootId tells a restarted hub (whose
+ * seq starts again at 1) from a stale packet.  Little-endian:
+ *
+ *   0    u8    magic      0xFC
+ *   1    u8    type       FC_HUB_COUNTS_TYPE
+ *   2    u8    nLanes
+ *   3    u8    hubId      0 … FC_MAX_HUBS-1
+ *   4    u32   seq        per-boot datagram number, from 1
+ *   8    u32   ts         sender millis()
+ *   12   u32   total
+ *   16   u32   okMask     bit i = lane i sensor online
+ *   20   u16   bootId     random per boot
+ *   22   u16   reserved   0
+ *   24   u32[nLanes] counts
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+static const uint8_t FC_HUB_COUNTS_TYPE = 6;
+static const size_t  FC_HUB_HEADER_BYTES = 24;
+static const uint8_t FC_HUB_MAX_LANES   = 32;
+static const uint8_t FC_MAX_HUBS        = 8;
+
+constexpr size_t hubCountsMax(uint8_t nLanes) {
+  return FC_HUB_HEADER_BYTES + 4u * nLanes;
+}
+
+struct HubCounts {
+  uint8_t  hubId;
+  uint8_t  nLanes;
+  uint32_t seq;
+  uint32_t ts_ms;
+  uint32_t total;
+  uint32_t okMask;
+  uint16_t bootId;
+};
+
+/**
+ * Encode one datagram.
+ * @return bytes written, or 0 if out is too small
+ */
+size_t encodeHubCounts(uint8_t* out, size_t cap, const HubCounts& hdr,
+                       const uint32_t* counts);
+
+/**
+ * Validate and unpack a datagram; counts must hold FC_HUB_MAX_LANES.
+ * @return false if it isn't a well-formed count datagram
+ */
+bool decodeHubCounts(const uint8_t* in, size_t len, HubCounts& hdr,
+                     uint32_t* counts);
+
+struct HubEntry {
+  bool     known    = false;
+  uint8_t  nLanes   = 0;
+  uint16_t bootId   = 0;
+  uint32_t seq      = 0;
+  uint32_t lastRxMs = 0;
+  uint32_t total    = 0;
+  uint32_t okMask   = 0;
+  uint32_t rx       = 0;               // datagrams accepted
+  uint32_t lost     = 0;               // seq gaps
+  uint32_t counts[FC_HUB_MAX_LANES] = {};
+};
+
+// Latest state of every remote hub, as seen by the aggregator.
+class HubTable {
+public:
+  enum Result : uint8_t { CHANGED, SAME, OLD };
+
+  // Apply a decoded datagram received at now_ms.
+  Result accept(const HubCounts& hdr, const uint32_t* counts, uint32_t now_ms);
+
+  // Sum of the last reported totals of the hubs still online (heard from
+  // within timeout_ms); a stale hub's count is last-known, not live.
+  uint32_t total(uint32_t now_ms, uint32_t timeout_ms) const;
+
+  // True if the hub reported within timeout_ms.
+  bool online(uint8_t id, uint32_t now_ms, uint32_t timeout_ms) const {
+    return id < FC_MAX_HUBS && hubs_[id].known &&
+           now_ms - hubs_[id].lastRxMs <= timeout_ms;
+  }
+
+  // Bit i = hub i online; compare across calls to spot hubs dropping out.
+  uint8_t onlineMask(uint32_t now_ms, uint32_t timeout_ms) const;
+
+  const HubEntry& hub(uint8_t id) const { return hubs_[id]; }
+
+private:
+  HubEntry hubs_[FC_MAX_HUBS];
+};
@@ -0,0 +1,120 @@
+/*******************************************************************************
+ * json_args.cpp — Zero-copy flat JSON lookup
+ ******************************************************************************/
+#include "json_args.h"
+#include <string.h>
+
+static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+// Advance past a string whose opening quote is at p[i]; returns index
+// of the closing quote, or end if unterminated.
+static size_t skipString(const char* p, size_t i, size_t end) {
+  for (i++; i < end; i++) {
+    if (p[i] == '\\') { i++; continue; }
+    if (p[i] == '"') return i;
+  }
+  return end;
+}
+
+bool JsonArgs::find(const char* key, const char*& val, size_t& valLen,
+                    bool& isString) const
+{
+  const char* p   = msg_;
+  const size_t end = len_;
+  const size_t keyLen = strlen(key);
+  size_t i = 0;
+
+  while (i < end && isSpace(p[i])) i++;
+  if (i >= end || p[i] != '{') return false;
+  i++;
+
+  while (i < end) {
+    while (i < end && (isSpace(p[i]) || p[i] == ',')) i++;
+    if (i >= end || p[i] == '}') return false;
+    if (p[i] != '"') return false;                  // malformed key
+
+    size_t kStart = i + 1;
+    size_t kEnd   = skipString(p, i, end);
+    if (kEnd >= end) return false;
+    i = kEnd + 1;
+    while (i < end && isSpace(p[i])) i++;
+    if (i >= end || p[i] != ':') return false;
+    i++;
+    while (i < end && isSpace(p[i])) i++;
+    if (i >= end) return false;
+
+    // Span the value
+    size_t vStart = i, vEnd;
+    bool   str    = false;
+    if (p[i] == '"') {
+      str    = true;
+      vStart = i + 1;
+      vEnd   = skipString(p, i, end);
+      if (vEnd >= end) return false;
+      i = vEnd + 1;
+    } else if (p[i] == '{' || p[i] == '[') {
+      int depth = 0;
+      for (; i < end; i++) {
+        if (p[i] == '"') { i = skipString(p, i, end); continue; }
+        if (p[i] == '{' || p[i] == '[') depth++;
+        if (p[i] == '}' || p[i] == ']') { if (--depth == 0) { i++; break; } }
+      }
+      vEnd = i;
+    } else {
+      while (i < end && p[i] != ',' && p[i] != '}' && !isSpace(p[i])) i++;
+      vEnd = i;
+    }
+
+    if (kEnd - kStart == keyLen && memcmp(p + kStart, key, keyLen) == 0) {
+      val      = p + vStart;
+      valLen   = vEnd - vStart;
+      isString = str;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool JsonArgs::getString(const char* key, const char*& p, size_t& n) const {
+  bool str;
+  return find(key, p, n, str) && str;
+}
+
+bool JsonArgs::number(const char* key, int64_t limit, int64_t& v) const {
+  const char* p;
+  size_t n;
+  bool str;
+  if (!find(key, p, n, str) || str || n == 0) return false;
+  size_t i = 0;
+  bool neg = false;
+  if (p[0] == '-' || p[0] == '+') { neg = p[0] == '-'; i = 1; }
+  if (i >= n || p[i] < '0' || p[i] > '9') return false;
+  int64_t acc = 0;
+  for (; i < n && p[i] >= '0' && p[i] <= '9'; i++) {
+    acc = acc * 10 + (p[i] - '0');
+    if (acc > limit) acc = limit;                   // saturate
+  }
+  v = neg ? -acc : acc;
+  return true;
+}
+
+bool JsonArgs::getInt(const char* key, int32_t& v) const {
+  int64_t x;
+  if (!number(key, 0x7FFFFFFFLL, x)) return false;
+  v = (int32_t)x;
+  return true;
+}
+
+bool JsonArgs::getUint(const char* key, uint32_t& v) const {
+  int64_t x;
+  if (!number(key, 0xFFFFFFFFLL, x) || x < 0) return false;
+  v = (uint32_t)x;
+  return true;
+}
+
+bool JsonArgs::has(const char* key) const {
+  const char* p;
+  size_t n;
+  bool str;
+  return find(key, p, n, str);
+}
@@ -0,0 +1,46 @@
+/*******************************************************************************
+ * json_args.h — Zero-copy reader for flat JSON command objects
+ *
+ * Looks values up directly in the received buffer — {"cmd":"set","lane":2,
+ * "delta":70} — without copying or allocating.  Only the top level is
+ * indexed; nested objects/arrays are skipped.  String values are returned
+ * as pointer + length into the original buffer (escapes are not decoded).
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+class JsonArgs {
+public:
+  JsonArgs(const char* msg, size_t len) : msg_(msg), len_(len) {}
+
+  // Top-level string value; p/n point into the message.
+  bool getString(const char* key, const char*& p, size_t& n) const;
+
+  // Top-level integer value (optional sign, digits; fraction ignored).
+  bool getInt(const char* key, int32_t& v) const;
+
+  // Top-level non-negative integer up to 2^32 − 1 (sequence numbers).
+  bool getUint(const char* key, uint32_t& v) const;
+
+  // getInt() with a fallback when the key is missing or not a number.
+  int32_t intOr(const char* key, int32_t fallback) const {
+    int32_t v;
+    return getInt(key, v) ? v : fallback;
+  }
+
+  bool has(const char* key) const;
+
+private:
+  /**
+   * Find key at the top level.  On success val/valLen span the raw value
+   * (without quotes for strings) and isString says which kind it was.
+   */
+  bool find(const char* key, const char*& val, size_t& valLen, bool& isString) const;
+
+  // Parse the numeric value of key, saturating at ±limit.
+  bool number(const char* key, int64_t limit, int64_t& v) const;
+
+  const char* msg_;
+  size_t      len_;
+};
@@ -0,0 +1,135 @@
+/*******************************************************************************
+ * json_writer.cpp — Allocation-free JSON serializer
+ ******************************************************************************/
+#include "json_writer.h"
+
+JsonWriter::JsonWriter(char* buf, size_t cap) : buf_(buf), cap_(cap) {
+  if (cap_ > 0) buf_[0] = '\0';
+}
+
+void JsonWriter::put(char c) {
+  // Always leave room for the terminating NUL
+  if (len_ + 1 >= cap_) { overflow_ = true; return; }
+  buf_[len_++] = c;
+  buf_[len_]   = '\0';
+}
+
+void JsonWriter::putRaw(const char* s) {
+  while (*s) put(*s++);
+}
+
+void JsonWriter::putUint(uint32_t v) {
+  char tmp[MAX_U32_DIGITS];
+  uint8_t n = 0;
+  do { tmp[n++] = (char)('0' + v % 10); v /= 10; } while (v);
+  while (n) put(tmp[--n]);
+}
+
+void JsonWriter::putString(const char* s) {
+  put('"');
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') put('\\');
+    put(*s);
+  }
+  put('"');
+}
+
+void JsonWriter::separator() {
+  uint32_t bit = 1u << depth_;
+  if (first_ & bit) first_ &= ~bit;
+  else              put(',');
+}
+
+void JsonWriter::putKey(const char* key) {
+  separator();
+  putString(key);
+  put(':');
+}
+
+JsonWriter& JsonWriter::beginObject() {
+  if (depth_ > 0) separator();
+  put('{');
+  depth_++;
+  first_ |= 1u << depth_;
+  return *this;
+}
+
+JsonWriter& JsonWriter::beginObject(const char* key) {
+  putKey(key);
+  put('{');
+  depth_++;
+  first_ |= 1u << depth_;
+  return *this;
+}
+
+JsonWriter& JsonWriter::endObject() {
+  put('}');
+  if (depth_ > 0) depth_--;
+  return *this;
+}
+
+JsonWriter& JsonWriter::beginArray() {
+  if (depth_ > 0) separator();
+  put('[');
+  depth_++;
+  first_ |= 1u << depth_;
+  return *this;
+}
+
+JsonWriter& JsonWriter::beginArray(const char* key) {
+  putKey(key);
+  put('[');
+  depth_++;
+  first_ |= 1u << depth_;
+  return *this;
+}
+
+JsonWriter& JsonWriter::endArray() {
+  put(']');
+  if (depth_ > 0) depth_--;
+  return *this;
+}
+
+JsonWriter& JsonWriter::field(const char* key, uint32_t value) {
+  putKey(key);
+  putUint(value);
+  return *this;
+}
+
+JsonWriter& JsonWriter::flag(const char* key, bool value) {
+  putKey(key);
+  putRaw(value ? "true" : "false");
+  return *this;
+}
+
+JsonWriter& JsonWriter::field(const char* key, const char* value) {
+  putKey(key);
+  putString(value);
+  return *this;
+}
+
+JsonWriter& JsonWriter::indexedField(char prefix, uint8_t index, uint32_t value) {
+  separator();
+  put('"'); put(prefix); putUint(index); put('"'); put(':');
+  putUint(value);
+  return *this;
+}
+
+JsonWriter& JsonWriter::indexedFlag(char prefix, uint8_t index, bool value) {
+  separator();
+  put('"'); put(prefix); putUint(index); put('"'); put(':');
+  putRaw(value ? "true" : "false");
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(uint32_t value) {
+  separator();
+  putUint(value);
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(const char* value) {
+  separator();
+  putString(value);
+  return *this;
+}
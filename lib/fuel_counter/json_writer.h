@@ -0,0 +1,58 @@
+/*******************************************************************************
+ * json_writer.h — Allocation-free JSON serializer into a caller buffer
+ *
+ * Writes straight into a fixed char array; never touches the heap.  If the
+ * buffer runs out the writer stops, flags overflow() and keeps the output
+ * NUL-terminated, so callers size buffers from a compile-time worst case.
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+class JsonWriter {
+public:
+  JsonWriter(char* buf, size_t cap);
+
+  // Containers.  The key overloads open a container as an object member.
+  JsonWriter& beginObject();
+  JsonWriter& beginObject(const char* key);
+  JsonWriter& endObject();
+  JsonWriter& beginArray();
+  JsonWriter& beginArray(const char* key);
+  JsonWriter& endArray();
+
+  // Object members ("key":value).
+  JsonWriter& field(const char* key, uint32_t value);
+  JsonWriter& field(const char* key, const char* value);
+  JsonWriter& flag(const char* key, bool value);
+
+  // Indexed member such as "l3":value (prefix + index, caller picks base).
+  JsonWriter& indexedField(char prefix, uint8_t index, uint32_t value);
+  JsonWriter& indexedFlag(char prefix, uint8_t index, bool value);
+
+  // Bare array elements.
+  JsonWriter& value(uint32_t value);
+  JsonWriter& value(const char* value);
+
+  const char* c_str()    const { return buf_; }
+  size_t      length()   const { return len_; }
+  bool        overflow() const { return overflow_; }
+
+  // Characters needed for the largest uint32_t (4294967295).
+  static const size_t MAX_U32_DIGITS = 10;
+
+private:
+  void separator();            // ',' between siblings
+  void put(char c);
+  void putRaw(const char* s);
+  void putUint(uint32_t v);
+  void putKey(const char* key);
+  void putString(const char* s);
+
+  char*    buf_;
+  size_t   cap_;
+  size_t   len_      = 0;
+  uint32_t first_    = 1;      // bit d set = no element written yet at depth d
+  uint8_t  depth_    = 0;
+  bool     overflow_ = false;
+};
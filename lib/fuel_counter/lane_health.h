@@ -0,0 +1,122 @@
+/*******************************************************************************
+ * lane_health.h — Per-lane sensor health and step-wise hot recovery
+ *
+ *   OK ──(degradeAfter consecutive timeouts)──► DEGRADED ──(sample)──► OK
+ *   DEGRADED ──(offlineAfter consecutive timeouts)──► OFFLINE
+ *   OFFLINE ──(retry delay)──► RECOVERING: one RecoveryStep at a time,
+ *       each reported back with stepDone(); a failed step goes back to
+ *       OFFLINE with a doubled retry delay, the last step returns to OK.
+ *
+ * The monitor only sequences; the firmware performs each step (power
+ * cycle, init, configure, start, calibrate).  Pure C++, header-only.
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+
+enum class LaneHealth : uint8_t { OK, DEGRADED, OFFLINE, RECOVERING };
+
+enum class RecoveryStep : uint8_t {
+  NONE,
+  POWER_DOWN,          // hold the sensor in reset (XSHUT builds only)
+  POWER_UP,            // release reset
+  INIT,                // library init (+ address assignment)
+  CONFIGURE,           // ranging profile
+  START,               // continuous ranging
+  CALIBRATE,           // start a background baseline calibration
+  WAIT_CALIBRATION,    // report stepDone() once it has finished
+};
+
+struct LaneHealthConfig {
+  uint8_t  degradeAfter;     // consecutive timeouts → DEGRADED
+  uint8_t  offlineAfter;     // consecutive timeouts → OFFLINE
+  uint16_t stepGap_ms;       // settle time between recovery steps
+  uint32_t retryMin_ms;      // first retry delay after going OFFLINE
+  uint32_t retryMax_ms;      // retry delay cap (doubles per failure)
+  bool     powerControl;     // POWER_DOWN / POWER_UP steps available
+};
+
+class LaneHealthMonitor {
+public:
+  void begin(const LaneHealthConfig* cfg, bool online, uint32_t now_ms) {
+    cfg_    = cfg;
+    timeouts_ = 0;
+    retry_ms_ = cfg->retryMin_ms;
+    if (online) { health_ = LaneHealth::OK; step_ = RecoveryStep::NONE; }
+    else        goOffline(now_ms, false);
+  }
+
+  LaneHealth   health()     const { return health_; }
+  RecoveryStep step()       const { return step_; }
+  uint16_t     recoveries() const { return recoveries_; }
+  uint16_t     failures()   const { return failures_; }
+
+  // A sample arrived: the lane is talking again.
+  void onSample() {
+    timeouts_ = 0;
+    if (health_ == LaneHealth::DEGRADED) health_ = LaneHealth::OK;
+  }
+
+  /**
+   * The lane missed a sample deadline.
+   * @return the new health if it just changed, else `health()` unchanged
+   *         (compare with the value before the call)
+   */
+  LaneHealth onTimeout(uint32_t now_ms) {
+    if (health_ != LaneHealth::OK && health_ != LaneHealth::DEGRADED) return health_;
+    if (timeouts_ < 255) timeouts_++;
+    if (timeouts_ >= cfg_->offlineAfter)      goOffline(now_ms, false);
+    else if (timeouts_ >= cfg_->degradeAfter) health_ = LaneHealth::DEGRADED;
+    return health_;
+  }
+
+  // Init or calibration failed outside of a recovery (ignored during one).
+  void markOffline(uint32_t now_ms) {
+    if (health_ == LaneHealth::RECOVERING || health_ == LaneHealth::OFFLINE) return;
+    goOffline(now_ms, false);
+  }
+
+  // Step to perform now (NONE if nothing is due yet).
+  RecoveryStep due(uint32_t now_ms) const {
+    if (health_ != LaneHealth::OFFLINE && health_ != LaneHealth::RECOVERING) {
+      return RecoveryStep::NONE;
+    }
+    if ((int32_t)(now_ms - nextAt_) < 0) return RecoveryStep::NONE;
+    return step_;
+  }
+
+  // Report the outcome of the step returned by due().
+  void stepDone(bool ok, uint32_t now_ms) {
+    if (!ok) { failures_++; goOffline(now_ms, true); return; }
+    if (step_ == RecoveryStep::WAIT_CALIBRATION) {
+      health_   = LaneHealth::OK;
+      step_     = RecoveryStep::NONE;
+      timeouts_ = 0;
+      retry_ms_ = cfg_->retryMin_ms;
+      recoveries_++;
+      return;
+    }
+    health_ = LaneHealth::RECOVERING;
+    step_   = (RecoveryStep)((uint8_t)step_ + 1);
+    // Calibration is polled, not timed: check it every loop
+    nextAt_ = now_ms + (step_ == RecoveryStep::WAIT_CALIBRATION ? 0 : cfg_->stepGap_ms);
+  }
+
+private:
+  void goOffline(uint32_t now_ms, bool backoff) {
+    health_ = LaneHealth::OFFLINE;
+    step_   = cfg_->powerControl ? RecoveryStep::POWER_DOWN : RecoveryStep::INIT;
+    nextAt_ = now_ms + retry_ms_;
+    if (backoff) {
+      retry_ms_ = retry_ms_ * 2 > cfg_->retryMax_ms ? cfg_->retryMax_ms : retry_ms_ * 2;
+    }
+  }
+
+  const LaneHealthConfig* cfg_ = nullptr;
+  LaneHealth   health_     = LaneHealth::OK;
+  RecoveryStep step_       = RecoveryStep::NONE;
+  uint8_t      timeouts_   = 0;
+  uint32_t     nextAt_     = 0;
+  uint32_t     retry_ms_   = 0;
+  uint16_t     recoveries_ = 0;
+  uint16_t     failures_   = 0;
+};
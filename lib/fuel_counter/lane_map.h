@@ -0,0 +1,25 @@
+/*******************************************************************************
+ * lane_map.h — Physical wiring of each lane (mux, mux channel)
+ *
+ * Pure data so the map can be stored with the calibration and unit-tested.
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+
+struct LaneWiring {
+  uint8_t mux;       // TCA9548A index (address = base + mux)
+  uint8_t channel;   // mux channel 0–7
+};
+
+// Default wiring: lanes fill mux channels in order, 8 lanes per mux.
+inline LaneWiring defaultLaneWiring(uint8_t lane) {
+  LaneWiring w;
+  w.mux     = lane / 8;
+  w.channel = lane % 8;
+  return w;
+}
+
+// Muxes that defaultLaneWiring() needs for numLanes lanes.
+inline uint8_t laneMuxCount(uint8_t numLanes) {
+  return (uint8_t)((numLanes + 7) / 8);
+}
@@ -0,0 +1,64 @@
+/*******************************************************************************
+ * log_ring.h — Fixed-size byte ring for deferred log output
+ *
+ * Whole lines go in with push() (all or nothing — a line that doesn't fit
+ * is dropped and counted, never truncated or waited for) and come out in
+ * contiguous chunks with peek()/consume() whenever the output has room.
+ * Single context only (not ISR-safe).  Pure C++, header-only.
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+template <uint16_t CAP>
+class LogRing {
+  static_assert(CAP >= 16 && (CAP & (CAP - 1)) == 0,
+                "LogRing capacity must be a power of two ≥ 16");
+
+public:
+  static const uint16_t CAPACITY = CAP;
+
+  // Queue len bytes; false (and one more dropped line) if they don't fit.
+  bool push(const char* s, uint16_t len) {
+    if (len > free()) {
+      dropped_++;
+      unreported_++;
+      return false;
+    }
+    uint16_t idx   = head_ & (CAP - 1);
+    uint16_t first = CAP - idx < len ? CAP - idx : len;
+    memcpy(buf_ + idx, s, first);
+    memcpy(buf_, s + first, len - first);
+    head_ = (uint16_t)(head_ + len);
+    return true;
+  }
+
+  /**
+   * Oldest queued bytes that are contiguous in memory.
+   * @return how many bytes p points at (0 when empty)
+   */
+  uint16_t peek(const char*& p) const {
+    uint16_t n = used();
+    if (!n) return 0;
+    uint16_t idx = tail_ & (CAP - 1);
+    p = buf_ + idx;
+    return CAP - idx < n ? CAP - idx : n;
+  }
+
+  void consume(uint16_t n) { tail_ = (uint16_t)(tail_ + n); }
+
+  uint16_t used() const { return (uint16_t)(head_ - tail_); }
+  uint16_t free() const { return CAP - used(); }
+
+  uint32_t dropped() const { return dropped_; }
+
+  // Lines dropped since the last call (for a "N dropped" notice).
+  uint32_t takeUnreported() { uint32_t n = unreported_; unreported_ = 0; return n; }
+
+private:
+  char     buf_[CAP];
+  uint16_t head_       = 0;   // free-running write index
+  uint16_t tail_       = 0;   // free-running read index
+  uint32_t dropped_    = 0;
+  uint32_t unreported_ = 0;
+};
@@ -0,0 +1,49 @@
+/*******************************************************************************
+ * ranging_profile.h — VL53L0X ranging presets (speed vs. range/accuracy)
+ *
+ * Pure data + lookup helpers; the firmware applies them to the sensor.
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+enum class RangingProfile : uint8_t { HIGH_SPEED, STANDARD, LONG_RANGE };
+
+static const uint8_t FC_NUM_PROFILES = 3;
+
+struct RangingParams {
+  uint32_t timingBudget_us;        // measurement timing budget
+  uint8_t  preRangeVcsel_pclks;    // pre-range VCSEL pulse period
+  uint8_t  finalRangeVcsel_pclks;  // final-range VCSEL pulse period
+  float    signalRateLimit_mcps;   // minimum return signal rate
+  const char* name;                // short name used on the WS command channel
+};
+
+// HIGH_SPEED trades ~±5 mm of accuracy for ~50 Hz sampling, which is what
+// fast-moving fuel needs.  STANDARD is the Pololu library default.
+// LONG_RANGE follows the ST long-range preset (lower signal limit, longer
+// VCSEL pulses) for lanes where the far wall is beyond ~1.2 m.
+static const RangingParams FC_RANGING_PARAMS[FC_NUM_PROFILES] = {
+  { 20000, 14, 10, 0.25f, "fast"    },
+  { 33000, 14, 10, 0.25f, "default" },
+  { 33000, 18, 14, 0.10f, "long"    },
+};
+
+inline const RangingParams& rangingParams(RangingProfile p) {
+  return FC_RANGING_PARAMS[(uint8_t)p < FC_NUM_PROFILES ? (uint8_t)p : 1];
+}
+
+/**
+ * Look up a profile by its short name ("fast", "default", "long").
+ * @return false if the name is unknown (out is left untouched)
+ */
+inline bool parseRangingProfile(const char* name, uint16_t len, RangingProfile& out) {
+  for (uint8_t i = 0; i < FC_NUM_PROFILES; i++) {
+    const char* n = FC_RANGING_PARAMS[i].name;
+    if (strlen(n) == len && memcmp(n, name, len) == 0) {
+      out = (RangingProfile)i;
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,92 @@
+/*******************************************************************************
+ * sample_filter.h — Outlier rejection ahead of the lane state machine
+ *
+ * Two integer stages, both optional, run over a whole batch of lanes:
+ *
+ *   1. Reject: a reading whose VL53L0X device range status is not
+ *      "range complete", or whose return signal rate is below its lane's
+ *      floor (minSignal_q7[i], set per ranging profile), is dropped (its lane bit is cleared from the batch mask).
+ *   2. Median of 3: each accepted reading is replaced by the median of it
+ *      and the lane's two previous accepted readings, so one stray short
+ *      (ambient spike, crosstalk) never reaches the counter.  Costs one
+ *      sample of latency; a real ball stays in the beam for several.
+ *
+ * Fixed cost per lane: three compares and two stores.  Pure C++, header-only.
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+
+// RESULT_RANGE_STATUS bits [6:3]; 11 = range complete (valid).
+static const uint8_t FC_RANGE_STATUS_VALID = 11;
+inline uint8_t deviceRangeStatus(uint8_t resultRangeStatus) {
+  return (uint8_t)((resultRangeStatus >> 3) & 0x0F);
+}
+
+inline uint16_t median3(uint16_t a, uint16_t b, uint16_t c) {
+  if (a > b) { uint16_t t = a; a = b; b = t; }   // a ≤ b
+  if (b > c) b = c;                               // b = min(b, c)
+  return a > b ? a : b;
+}
+
+template <uint8_t N>
+struct SampleFilterBank {
+  bool      median          = true;
+  bool      checkStatus     = true;
+
+  uint16_t  minSignal_q7[N] = {};      // MCPS in 9.7 fixed point; 0 = off
+  uint16_t  prev1[N]        = {};      // last accepted reading
+  uint16_t  prev2[N]        = {};      // the one before
+  uint8_t   primed[N]       = {};      // readings in the history (0–2)
+  uint32_t  rejected[N]     = {};      // dropped on status / signal
+
+  void configure(bool useMedian, bool useStatus, uint16_t minSignalQ7) {
+    median      = useMedian;
+    checkStatus = useStatus;
+    for (uint8_t i = 0; i < N; i++) minSignal_q7[i] = minSignalQ7;
+  }
+
+  // Lane i's signal floor (follows its ranging profile's signal limit).
+  void setMinSignal(uint8_t i, uint16_t minSignalQ7) { minSignal_q7[i] = minSignalQ7; }
+
+  // Forget a lane's history (after a recalibration or a sensor restart).
+  void resetLane(uint8_t i) { primed[i] = 0; }
+
+  /**
+   * Filter one batch in place.
+   *
+   * @param dist    N readings, indexed by lane; accepted entries are
+   *                replaced by their filtered value
+   * @param status  N raw RESULT_RANGE_STATUS bytes (nullptr: skip the check)
+   * @param signal  N signal rates, MCPS 9.7 (nullptr: skip the check)
+   * @param mask    lanes whose entries are fresh
+   * @return mask with rejected lanes cleared
+   */
+  uint32_t filterReadings(uint16_t* dist, const uint8_t* status,
+                          const uint16_t* signal, uint32_t mask)
+  {
+    uint32_t kept = mask;
+    for (uint8_t i = 0; i < N; i++) {
+      if (!((mask >> i) & 1u)) continue;
+      bool bad = (checkStatus && status &&
+                  deviceRangeStatus(status[i]) != FC_RANGE_STATUS_VALID) ||
+                 (minSignal_q7[i] && signal && signal[i] < minSignal_q7[i]);
+      if (bad) {
+        rejected[i]++;
+        kept &= ~(1u << i);
+        continue;
+      }
+      uint16_t d = dist[i];
+      if (primed[i] < 2) {            // warm-up: seed the history
+        if (primed[i] == 0) prev1[i] = d;
+        prev2[i] = prev1[i];
+        prev1[i] = d;
+        primed[i]++;
+        continue;                     // pass through unfiltered
+      }
+      if (median) dist[i] = median3(d, prev1[i], prev2[i]);
+      prev2[i] = prev1[i];
+      prev1[i] = d;
+    }
+    return kept;
+  }
+};
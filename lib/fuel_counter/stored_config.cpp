@@ -0,0 +1,55 @@
+/*******************************************************************************
+ * stored_config.cpp — Stored configuration validation
+ ******************************************************************************/
+#include "stored_config.h"
+
+uint16_t crc16Ccitt(const uint8_t* data, size_t len) {
+  uint16_t crc = 0xFFFF;
+  while (len--) {
+    crc ^= (uint16_t)(*data++) << 8;
+    for (uint8_t b = 0; b < 8; b++) {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+static uint16_t configCrc(const StoredConfig& cfg) {
+  return crc16Ccitt((const uint8_t*)&cfg, offsetof(StoredConfig, crc));
+}
+
+void sealConfig(StoredConfig& cfg, uint8_t wiring) {
+  cfg.magic    = FC_CONFIG_MAGIC;
+  cfg.version  = FC_CONFIG_VERSION;
+  cfg.nLanes   = FC_NUM_LANES;
+  cfg.wiring   = wiring;
+  cfg.reserved = 0;
+  cfg.size     = sizeof(StoredConfig);
+  cfg.crc      = configCrc(cfg);
+}
+
+bool configValid(const StoredConfig& cfg, uint8_t wiring, uint8_t muxCount) {
+  if (cfg.magic != FC_CONFIG_MAGIC || cfg.version != FC_CONFIG_VERSION ||
+      cfg.nLanes != FC_NUM_LANES || cfg.wiring != wiring || cfg.size != sizeof(StoredConfig)) {
+    return false;
+  }
+  if (cfg.crc != configCrc(cfg)) return false;
+  for (uint8_t i = 0; i < FC_NUM_LANES; i++) {
+    const StoredLane& l = cfg.lane[i];
+    if (l.wiring.mux >= muxCount || l.wiring.channel > 7 ||
+        l.profile >= FC_NUM_PROFILES) {
+      return false;
+    }
+    if (!l.calibrated) continue;
+    if (l.delta_mm >= l.baseline_mm || l.hyst_mm >= l.delta_mm) return false;
+  }
+  return true;
+}
+
+uint32_t uncalibratedLanes(const StoredConfig& cfg) {
+  uint32_t mask = 0;
+  for (uint8_t i = 0; i < FC_NUM_LANES; i++) {
+    if (!cfg.lane[i].calibrated) mask |= 1u << i;
+  }
+  return mask;
+}
@@ -0,0 +1,100 @@
+/*******************************************************************************
+ * stored_config.h — Calibration + configuration image kept in EEPROM
+ *
+ * One fixed-size POD record (baselines, thresholds, ranging profiles and
+ * lane map) with a CRC, so a warm boot can start counting without
+ * recalibrating.  The firmware does the EEPROM I/O; this file only knows
+ * the layout and how to validate it.
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "fuel_counter.h"
+#include "lane_map.h"
+#include "ranging_profile.h"
+
+static const uint32_t FC_CONFIG_MAGIC   = 0x46434346;   // "FCCF"
+static const uint8_t  FC_CONFIG_VERSION = 5;
+
+// How the build that wrote the image reaches its sensors (StoredConfig::wiring).
+static const uint8_t  FC_WIRING_MUX     = 0;      // TCA9548A mux(es)
+static const uint8_t  FC_WIRING_XSHUT   = 1;      // per-lane XSHUT pins, no mux
+
+struct StoredLane {
+  uint16_t baseline_mm;
+  uint16_t delta_mm;        // baseline − threshold
+  uint16_t hyst_mm;         // clear threshold − threshold
+  uint8_t  profile;         // RangingProfile
+  LaneWiring wiring;
+  uint16_t lockout_ms;      // hand-set lockout ({"cmd":"set"}); 0 = adaptive
+  uint8_t  calibrated;      // 0 = no baseline yet (lane was offline or failed)
+};
+
+struct StoredConfig {
+  uint32_t   magic;
+  uint8_t    version;
+  uint8_t    nLanes;        // must equal FC_NUM_LANES
+  uint8_t    wiring;        // FC_WIRING_MUX / FC_WIRING_XSHUT
+  uint8_t    reserved;
+  uint16_t   size;          // sizeof(StoredConfig)
+  StoredLane lane[FC_NUM_LANES];
+  uint16_t   crc;           // CRC-16/CCITT over everything before it
+};
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF).
+uint16_t crc16Ccitt(const uint8_t* data, size_t len);
+
+// Fill the header fields and CRC; call after the lane records are set.
+void sealConfig(StoredConfig& cfg, uint8_t wiring);
+
+/**
+ * True if cfg was sealed by this firmware layout for this lane/wiring
+ * setup and every lane record is usable: its mux index is below muxCount,
+ * and on calibrated lanes delta < baseline, hyst < delta so the thresholds
+ * land between 0 and the baseline.
+ */
+bool configValid(const StoredConfig& cfg, uint8_t wiring, uint8_t muxCount);
+
+// Lanes of a valid image that have no stored baseline; they cold-calibrate.
+uint32_t uncalibratedLanes(const StoredConfig& cfg);
+
+/**
+ * Warm-boot sanity check for one lane: collects the first `samples`
+ * readings after boot and compares their mean with the stored baseline.
+ * A window whose spread exceeds maxSpread_mm (a ball went by) is thrown
+ * away and collection starts over.
+ */
+class BaselineCheck {
+public:
+  enum Result : uint8_t { PENDING, MATCH, MISMATCH };
+
+  void begin(uint16_t stored_mm, uint8_t samples,
+             uint16_t tolerance_mm, uint16_t maxSpread_mm)
+  {
+    stored_ = stored_mm; samples_ = samples;
+    tolerance_ = tolerance_mm; maxSpread_ = maxSpread_mm;
+    restart();
+  }
+
+  Result add(uint16_t d) {
+    if (d < lo_) lo_ = d;
+    if (d > hi_) hi_ = d;
+    sum_ += d;
+    if (++n_ < samples_) return PENDING;
+    if (hi_ - lo_ > maxSpread_) { restart(); return PENDING; }
+    uint16_t m  = mean();
+    uint16_t df = m > stored_ ? m - stored_ : stored_ - m;
+    return df > tolerance_ ? MISMATCH : MATCH;
+  }
+
+  // Mean of the completed window (valid once add() stops returning PENDING).
+  uint16_t mean() const { return n_ ? (uint16_t)(sum_ / n_) : 0; }
+
+private:
+  void restart() { n_ = 0; sum_ = 0; lo_ = 0xFFFF; hi_ = 0; }
+
+  uint16_t stored_ = 0, tolerance_ = 0, maxSpread_ = 0;
+  uint8_t  samples_ = 1, n_ = 0;
+  uint32_t sum_ = 0;
+  uint16_t lo_ = 0xFFFF, hi_ = 0;
+};
@@ -0,0 +1,125 @@
+/*******************************************************************************
+ * telemetry.h — Batched raw-sample datagrams for live lane diagnostics
+ *
+ * Every sample of every lane is appended to the front half of a
+ * preallocated double buffer.  Once the front batch is TELEMETRY_PERIOD
+ * old (or full) it is sealed and swapped to the back, where it waits for
+ * the sender; the sample path never waits for the network.  If the back
+ * batch still hasn't gone out when the front fills, new samples are
+ * dropped and counted in the next header.  Little-endian:
+ *
+ *   0    u8    magic      0xFC
+ *   1    u8    type       FC_TELEMETRY_TYPE
+ *   2    u8    nLanes
+ *   3    u8    version    1
+ *   4    u32   seq        datagram number
+ *   8    u32   baseTs     millis() of the first sample
+ *   12   u16   nRecords
+ *   14   u16   dropped    samples lost since the previous datagram (saturating)
+ *   16   records, FC_TELEMETRY_RECORD_BYTES each:
+ *          u8  lane
+ *          u8  flags      bits 0–1 LaneState before this sample,
+ *                         bit 6 sensor online, bit 7 calibrating
+ *          u8  status     raw RESULT_RANGE_STATUS (0 if not read)
+ *          u16 dt         ms after baseTs
+ *          u16 distance   mm, unfiltered
+ *
+ * Pure C++, header-only.
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "ws_protocol.h"   // FC_WS_MAGIC, little-endian helpers
+
+static const uint8_t FC_TELEMETRY_TYPE          = 7;
+static const uint8_t FC_TELEMETRY_VERSION       = 1;
+static const size_t  FC_TELEMETRY_HEADER_BYTES  = 16;
+static const size_t  FC_TELEMETRY_RECORD_BYTES  = 7;
+static const uint8_t FC_TELEMETRY_ONLINE        = 0x40;
+static const uint8_t FC_TELEMETRY_CALIBRATING   = 0x80;
+
+template <size_t BYTES>
+class TelemetryDoubleBuffer {
+  static_assert(BYTES >= FC_TELEMETRY_HEADER_BYTES + FC_TELEMETRY_RECORD_BYTES,
+                "telemetry batch too small");
+
+public:
+  static const uint16_t MAX_RECORDS =
+      (uint16_t)((BYTES - FC_TELEMETRY_HEADER_BYTES) / FC_TELEMETRY_RECORD_BYTES);
+
+  explicit TelemetryDoubleBuffer(uint8_t nLanes) : nLanes_(nLanes) {}
+
+  // Drop everything (e.g. when the channel is switched on).
+  void clear() { n_[0] = n_[1] = 0; ready_ = false; dropped_ = 0; }
+
+  /**
+   * Append one sample; O(1), never blocks.
+   * @return false if both halves were full and the sample was dropped
+   */
+  bool add(uint8_t lane, uint32_t ts_ms, uint16_t dist, uint8_t flags, uint8_t status) {
+    uint8_t f = front_;
+    if (n_[f] && (ts_ms - base_[f] > 0xFFFFu || n_[f] == MAX_RECORDS)) {
+      if (!swap()) { dropped_++; return false; }
+      f = front_;
+    }
+    if (n_[f] == 0) base_[f] = ts_ms;
+    uint8_t* r = buf_[f] + FC_TELEMETRY_HEADER_BYTES + (size_t)n_[f] * FC_TELEMETRY_RECORD_BYTES;
+    r[0] = lane;
+    r[1] = flags;
+    r[2] = status;
+    putLe16(r + 3, (uint16_t)(ts_ms - base_[f]));
+    putLe16(r + 5, dist);
+    n_[f]++;
+    return true;
+  }
+
+  // Seal the front batch if it is at least period_ms old and the back is free.
+  void flushIfDue(uint32_t now_ms, uint32_t period_ms) {
+    if (n_[front_] && now_ms - base_[front_] >= period_ms) swap();
+  }
+
+  // Sealed batch waiting to be sent, or nullptr.
+  const uint8_t* ready(size_t& len) const {
+    if (!ready_) return nullptr;
+    uint8_t b = front_ ^ 1u;
+    len = FC_TELEMETRY_HEADER_BYTES + (size_t)n_[b] * FC_TELEMETRY_RECORD_BYTES;
+    return buf_[b];
+  }
+
+  // The ready batch has been sent (or given up on).
+  void release() { ready_ = false; n_[front_ ^ 1u] = 0; }
+
+  uint32_t dropped() const { return droppedTotal_; }
+
+private:
+  // Seal the front into the back half; false if the back is still queued.
+  bool swap() {
+    if (ready_) return false;
+    uint8_t  f = front_;
+    uint8_t* h = buf_[f];
+    h[0] = FC_WS_MAGIC;
+    h[1] = FC_TELEMETRY_TYPE;
+    h[2] = nLanes_;
+    h[3] = FC_TELEMETRY_VERSION;
+    putLe32(h + 4, ++seq_);
+    putLe32(h + 8, base_[f]);
+    putLe16(h + 12, n_[f]);
+    putLe16(h + 14, dropped_ > 0xFFFFu ? 0xFFFFu : (uint16_t)dropped_);
+    droppedTotal_ += dropped_;
+    dropped_ = 0;
+    ready_   = true;
+    front_   = f ^ 1u;
+    n_[front_] = 0;
+    return true;
+  }
+
+  uint8_t  buf_[2][BYTES];
+  uint16_t n_[2]         = { 0, 0 };
+  uint32_t base_[2]      = { 0, 0 };
+  uint8_t  front_        = 0;
+  bool     ready_        = false;
+  uint8_t  nLanes_;
+  uint32_t seq_          = 0;
+  uint32_t dropped_      = 0;
+  uint32_t droppedTotal_ = 0;
+};
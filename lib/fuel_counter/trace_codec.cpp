@@ -0,0 +1,123 @@
+/*******************************************************************************
+ * trace_codec.cpp — Delta-encoded raw distance trace blocks
+ ******************************************************************************/
+#include "trace_codec.h"
+
+static uint16_t fletcher16(const uint8_t* p, size_t n) {
+  uint16_t a = 0, b = 0;
+  while (n--) {
+    a = (uint16_t)((a + *p++) % 255);
+    b = (uint16_t)((b + a) % 255);
+  }
+  return (uint16_t)((b << 8) | a);
+}
+
+static uint8_t* putVarint(uint8_t* p, uint32_t v) {
+  while (v >= 0x80) { *p++ = (uint8_t)(v | 0x80); v >>= 7; }
+  *p++ = (uint8_t)v;
+  return p;
+}
+
+static bool getVarint(const uint8_t*& p, const uint8_t* end, uint32_t& v) {
+  v = 0;
+  for (uint8_t shift = 0; p < end && shift < 35; shift += 7) {
+    uint8_t b = *p++;
+    v |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) return true;
+  }
+  return false;
+}
+
+// ── Encoder ─────────────────────────────────────────────────────────────
+
+TraceEncoder::TraceEncoder(uint8_t* buf, size_t cap, uint8_t nLanes)
+  : buf_(buf), cap_(cap),
+    nLanes_(nLanes > FC_TRACE_MAX_LANES ? FC_TRACE_MAX_LANES : nLanes) {}
+
+void TraceEncoder::restart() {
+  len_     = FC_TRACE_HEADER_BYTES;
+  samples_ = 0;
+  sealed_  = false;
+  for (uint8_t i = 0; i < FC_TRACE_MAX_LANES; i++) prevDist_[i] = 0;
+}
+
+bool TraceEncoder::add(uint8_t lane, uint32_t ts_ms, uint16_t dist_mm) {
+  if (sealed_) restart();
+  if (lane >= nLanes_) return true;                 // not representable; drop
+  if (len_ + FC_TRACE_MAX_RECORD + FC_TRACE_TRAILER_BYTES > cap_ ||
+      samples_ == 0xFFFF) {
+    return false;
+  }
+  if (samples_ == 0) { baseTs_ = ts_ms; lastTs_ = ts_ms; }
+
+  int32_t  delta  = (int32_t)dist_mm - (int32_t)prevDist_[lane];
+  uint32_t zigzag = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+  uint8_t* p = buf_ + len_;
+  *p++ = lane;
+  p = putVarint(p, ts_ms - lastTs_);
+  p = putVarint(p, zigzag);
+  len_ = p - buf_;
+
+  prevDist_[lane] = dist_mm;
+  lastTs_ = ts_ms;
+  samples_++;
+  return true;
+}
+
+size_t TraceEncoder::finish() {
+  if (sealed_ || samples_ == 0) return 0;
+  buf_[0] = FC_WS_MAGIC;
+  buf_[1] = (uint8_t)WsFrameType::TRACE;
+  buf_[2] = nLanes_;
+  buf_[3] = FC_TRACE_VERSION;
+  putLe16(buf_ + 4, samples_);
+  putLe16(buf_ + 6, (uint16_t)(len_ - FC_TRACE_HEADER_BYTES));
+  putLe32(buf_ + 8, baseTs_);
+  putLe16(buf_ + len_, fletcher16(buf_ + 2, len_ - 2));
+  sealed_ = true;
+  return len_ + FC_TRACE_TRAILER_BYTES;
+}
+
+// ── Reader ──────────────────────────────────────────────────────────────
+
+size_t TraceBlockReader::check(const uint8_t* data, size_t len) {
+  if (len < FC_TRACE_HEADER_BYTES + FC_TRACE_TRAILER_BYTES) return 0;
+  if (data[0] != FC_WS_MAGIC || data[1] != (uint8_t)WsFrameType::TRACE ||
+      data[3] != FC_TRACE_VERSION || data[2] > FC_TRACE_MAX_LANES) {
+    return 0;
+  }
+  size_t body  = FC_TRACE_HEADER_BYTES + getLe16(data + 6);
+  size_t total = body + FC_TRACE_TRAILER_BYTES;
+  if (total > len) return 0;
+  if (getLe16(data + body) != fletcher16(data + 2, body - 2)) return 0;
+  return total;
+}
+
+bool TraceBlockReader::open(const uint8_t* data, size_t len) {
+  size_t total = check(data, len);
+  if (!total) return false;
+  nLanes_  = data[2];
+  samples_ = getLe16(data + 4);
+  ts_      = getLe32(data + 8);
+  p_       = data + FC_TRACE_HEADER_BYTES;
+  end_     = data + total - FC_TRACE_TRAILER_BYTES;
+  for (uint8_t i = 0; i < FC_TRACE_MAX_LANES; i++) prevDist_[i] = 0;
+  return true;
+}
+
+bool TraceBlockReader::next(TraceSample& out) {
+  if (p_ >= end_) return false;
+  uint8_t lane = *p_++;
+  uint32_t dt, zigzag;
+  if (lane >= nLanes_ || !getVarint(p_, end_, dt) || !getVarint(p_, end_, zigzag)) {
+    p_ = end_;
+    return false;
+  }
+  int32_t delta = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+  ts_ += dt;
+  prevDist_[lane] = (uint16_t)(prevDist_[lane] + delta);
+  out.ts_ms   = ts_;
+  out.lane    = lane;
+  out.dist_mm = prevDist_[lane];
+  return true;
+}
@@ -0,0 +1,97 @@
+/*******************************************************************************
+ * trace_codec.h — Compact delta-encoded raw distance traces
+ *
+ * Samples are packed into self-contained blocks, each one a valid binary
+ * WebSocket frame (type TRACE) so the same bytes can go to a socket client
+ * or straight down Serial.  The sync byte plus checksum lets a reader pick
+ * blocks out of a Serial capture that also has text log lines in it.
+ *
+ *   off  size  field
+ *   0    u8    magic      (FC_WS_MAGIC)
+ *   1    u8    type       (WsFrameType::TRACE)
+ *   2    u8    nLanes
+ *   3    u8    version    (FC_TRACE_VERSION)
+ *   4    u16   nSamples
+ *   6    u16   payloadLen
+ *   8    u32   baseTs     millis() the first sample's dt is relative to
+ *   12   ...   records
+ *   end  u16   Fletcher-16 over bytes 2 .. end of records
+ *
+ * Record: u8 lane, varint dt_ms (since the previous record in the block),
+ * zigzag varint (distance − previous distance on that lane; the first
+ * sample of a lane in a block is relative to 0).  Steady lanes cost about
+ * 3 bytes per sample.
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "ws_protocol.h"
+
+static const uint8_t FC_TRACE_VERSION       = 1;
+static const size_t  FC_TRACE_HEADER_BYTES  = 12;
+static const size_t  FC_TRACE_TRAILER_BYTES = 2;
+static const size_t  FC_TRACE_MAX_RECORD    = 1 + 5 + 3;   // lane + dt + delta
+static const uint8_t FC_TRACE_MAX_LANES     = 32;
+
+struct TraceSample {
+  uint32_t ts_ms;
+  uint8_t  lane;
+  uint16_t dist_mm;
+};
+
+/**
+ * Builds one block at a time in a caller-owned buffer.  When add() returns
+ * false the block is full: finish() it, send data(), then add() again (the
+ * next add() after finish() starts a new block).
+ */
+class TraceEncoder {
+public:
+  TraceEncoder(uint8_t* buf, size_t cap, uint8_t nLanes);
+
+  bool add(uint8_t lane, uint32_t ts_ms, uint16_t dist_mm);
+
+  // Seal the current block; returns its length (0 if it has no samples).
+  size_t finish();
+
+  const uint8_t* data()    const { return buf_; }
+  uint16_t       samples() const { return sealed_ ? 0 : samples_; }
+  uint32_t       baseTs()  const { return baseTs_; }
+
+private:
+  void restart();
+
+  uint8_t* buf_;
+  size_t   cap_;
+  uint8_t  nLanes_;
+  size_t   len_     = FC_TRACE_HEADER_BYTES;
+  uint16_t samples_ = 0;
+  bool     sealed_  = false;
+  uint32_t baseTs_  = 0;
+  uint32_t lastTs_  = 0;
+  uint16_t prevDist_[FC_TRACE_MAX_LANES] = {};
+};
+
+/** Walks the samples of one validated block. */
+class TraceBlockReader {
+public:
+  /**
+   * Length of the valid block starting at data, or 0 if data does not
+   * start with one (wrong magic/type/version, truncated, bad checksum).
+   */
+  static size_t check(const uint8_t* data, size_t len);
+
+  // Start reading a block; returns false if check() rejects it.
+  bool open(const uint8_t* data, size_t len);
+  bool next(TraceSample& out);
+
+  uint8_t  lanes()   const { return nLanes_; }
+  uint16_t samples() const { return samples_; }
+
+private:
+  const uint8_t* p_   = nullptr;
+  const uint8_t* end_ = nullptr;
+  uint8_t  nLanes_    = 0;
+  uint16_t samples_   = 0;
+  uint32_t ts_        = 0;
+  uint16_t prevDist_[FC_TRACE_MAX_LANES] = {};
+};
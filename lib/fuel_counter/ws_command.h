@@ -0,0 +1,77 @@
+/*******************************************************************************
+ * ws_command.h — Table-driven dispatch of {"cmd":"…"} WebSocket messages
+ *
+ * Handlers are registered by name once; dispatch() reads "cmd" in place,
+ * hashes it and jumps to the handler through a small open-addressed table,
+ * so adding commands costs neither time per message nor heap.  Handlers get
+ * the message's JsonArgs for their own parameters plus an opaque context
+ * pointer (the firmware passes the sending client).
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "json_args.h"
+
+typedef void (*WsCommandFn)(const JsonArgs& args, void* ctx);
+
+struct WsCommand {
+  const char* name;
+  WsCommandFn fn;
+};
+
+// FNV-1a over a (pointer, length) name.
+inline uint16_t wsCommandHash(const char* s, size_t n) {
+  uint32_t h = 2166136261u;
+  while (n--) { h ^= (uint8_t)*s++; h *= 16777619u; }
+  return (uint16_t)(h ^ (h >> 16));
+}
+
+template <uint8_t SLOTS>
+class WsCommandTable {
+  static_assert(SLOTS >= 2 && (SLOTS & (SLOTS - 1)) == 0,
+                "WsCommandTable size must be a power of two");
+
+public:
+  enum Result : uint8_t { OK, NO_CMD, UNKNOWN };
+
+  // Register a command; false if the table is full (keep it ≤ ¾ full).
+  bool add(const char* name, WsCommandFn fn) {
+    size_t n = strlen(name);
+    uint8_t i = wsCommandHash(name, n) & (SLOTS - 1);
+    for (uint8_t probe = 0; probe < SLOTS; probe++, i = (i + 1) & (SLOTS - 1)) {
+      if (!slots_[i].fn) { slots_[i] = { name, fn }; return true; }
+    }
+    return false;
+  }
+
+  bool add(const WsCommand* cmds, uint8_t count) {
+    bool ok = true;
+    for (uint8_t k = 0; k < count; k++) ok &= add(cmds[k].name, cmds[k].fn);
+    return ok;
+  }
+
+  Result dispatch(const char* msg, size_t len, void* ctx) const {
+    JsonArgs args(msg, len);
+    const char* name;
+    size_t n;
+    if (!args.getString("cmd", name, n)) return NO_CMD;
+    WsCommandFn fn = lookup(name, n);
+    if (!fn) return UNKNOWN;
+    fn(args, ctx);
+    return OK;
+  }
+
+  WsCommandFn lookup(const char* name, size_t n) const {
+    uint8_t i = wsCommandHash(name, n) & (SLOTS - 1);
+    for (uint8_t probe = 0; probe < SLOTS; probe++, i = (i + 1) & (SLOTS - 1)) {
+      const WsCommand& c = slots_[i];
+      if (!c.fn) return nullptr;
+      if (strncmp(c.name, name, n) == 0 && c.name[n] == '\0') return c.fn;
+    }
+    return nullptr;
+  }
+
+private:
+  WsCommand slots_[SLOTS] = {};
+};
@@ -0,0 +1,54 @@
+/*******************************************************************************
+ * ws_protocol.cpp — Binary WebSocket frame encoder
+ ******************************************************************************/
+#include "ws_protocol.h"
+
+size_t encodeCountsFrame(uint8_t* out, size_t cap,
+                         const WsCountsHeader& hdr, const uint32_t* counts)
+{
+  uint8_t carried = 0;
+  for (uint8_t i = 0; i < hdr.nLanes; i++) {
+    if ((hdr.laneMask >> i) & 1u) carried++;
+  }
+  size_t len = FC_WS_HEADER_BYTES + 4u * carried + (hdr.hasAge ? 4u : 0u);
+  if (len > cap) return 0;
+
+  out[0] = FC_WS_MAGIC;
+  out[1] = (uint8_t)hdr.type;
+  out[2] = hdr.nLanes;
+  out[3] = hdr.hasAge ? FC_WS_FLAG_AGE : 0;
+  putLe32(out + 4,  hdr.seq);
+  putLe32(out + 8,  hdr.ts_ms);
+  putLe32(out + 12, hdr.total);
+  putLe32(out + 16, hdr.okMask);
+  putLe32(out + 20, hdr.laneMask);
+  putLe32(out + 24, hdr.eventSeq);
+
+  uint8_t* p = out + FC_WS_HEADER_BYTES;
+  for (uint8_t i = 0; i < hdr.nLanes; i++) {
+    if (!((hdr.laneMask >> i) & 1u)) continue;
+    putLe32(p, counts[i]);
+    p += 4;
+  }
+  if (hdr.hasAge) putLe32(p, hdr.countAge_ms);
+  return len;
+}
+
+void encodeEventsHeader(uint8_t* out, uint8_t nLanes, uint32_t firstSeq,
+                        uint32_t ts_ms, uint16_t nEvents)
+{
+  out[0] = FC_WS_MAGIC;
+  out[1] = (uint8_t)WsFrameType::EVENTS;
+  out[2] = nLanes;
+  out[3] = 0;
+  putLe32(out + 4,  firstSeq);
+  putLe32(out + 8,  ts_ms);
+  putLe16(out + 12, nEvents);
+  putLe16(out + 14, 0);
+}
+
+void encodeEventRecord(uint8_t* out, uint8_t lane, uint32_t ts_ms)
+{
+  out[0] = lane;
+  putLe32(out + 1, ts_ms);
+}
@@ -0,0 +1,104 @@
+/*******************************************************************************
+ * ws_protocol.h — Compact binary WebSocket frames for count updates
+ *
+ * Clients opt in with {"cmd":"proto","bin":1}; everyone else keeps the JSON
+ * snapshots.  All multi-byte fields are little-endian.
+ *
+ *   off  size  field
+ *   0    u8    magic      (FC_WS_MAGIC)
+ *   1    u8    type       (WsFrameType)
+ *   2    u8    nLanes     lanes on this hub
+ *   3    u8    flags      FC_WS_FLAG_*
+ *   4    u32   seq        delta sequence number (snapshots carry the current one)
+ *   8    u32   ts         sender millis()
+ *   12   u32   total
+ *   16   u32   okMask     bit i = lane i sensor online
+ *   20   u32   laneMask   lanes whose count follows (all lanes for a snapshot)
+ *   24   u32   eventSeq   sequence number of the newest count event included
+ *   28   u32[] counts     one per set bit of laneMask, lowest lane first
+ *   …    u32   countAge   only with FC_WS_FLAG_AGE: ms from the capture of
+ *                         the oldest count in this frame to ts
+ *
+ * countAge plus a ping/pong clock offset gives the page the end-to-end
+ * latency from a ball clearing the sensor to the number on screen.
+ *
+ * EVENTS frames answer {"cmd":"resume","seq":N} with the count events the
+ * client missed:
+ *
+ *   0    u8    magic, 1 u8 type (EVENTS), 2 u8 nLanes, 3 u8 reserved
+ *   4    u32   firstSeq   sequence number of the first record
+ *   8    u32   ts         sender millis()
+ *   12   u16   nEvents
+ *   14   u16   reserved   0
+ *   16   {u8 lane, u32 ts}[nEvents]   5 bytes each, consecutive seqs
+ *
+ * TRACE frames carry raw distance samples while capture is on; their
+ * layout is described in trace_codec.h.
+ ******************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+static const uint8_t FC_WS_MAGIC        = 0xFC;
+static const size_t  FC_WS_HEADER_BYTES = 28;
+static const size_t  FC_WS_EVENTS_HEADER_BYTES = 16;
+static const size_t  FC_WS_EVENT_BYTES  = 5;
+static const uint8_t FC_WS_FLAG_AGE     = 0x01;   // countAge trailer follows
+
+enum class WsFrameType : uint8_t {
+  SNAPSHOT = 1,   // every lane's count
+  DELTA    = 2,   // only lanes that changed since the previous delta
+  EVENTS   = 3,   // batch of sequenced count events (resume reply)
+  TRACE    = 4,   // raw distance trace block (see trace_codec.h)
+};
+
+// Largest counts frame for a given lane count.
+constexpr size_t wsCountsFrameMax(uint8_t nLanes) {
+  return FC_WS_HEADER_BYTES + 4u * nLanes + 4u;
+}
+
+struct WsCountsHeader {
+  WsFrameType type;
+  uint8_t     nLanes;
+  uint32_t    seq;
+  uint32_t    ts_ms;
+  uint32_t    total;
+  uint32_t    okMask;
+  uint32_t    laneMask;
+  uint32_t    eventSeq;
+  bool        hasAge;     // new counts in this frame: append countAge
+  uint32_t    countAge_ms;
+};
+
+/**
+ * Encode a snapshot / delta frame.
+ * @param counts  full per-lane count array (nLanes entries); only lanes in
+ *                hdr.laneMask are written
+ * @return bytes written, or 0 if out is too small
+ */
+size_t encodeCountsFrame(uint8_t* out, size_t cap,
+                         const WsCountsHeader& hdr, const uint32_t* counts);
+
+/**
+ * Write an EVENTS frame header; the caller appends nEvents records with
+ * encodeEventRecord() at FC_WS_EVENTS_HEADER_BYTES + k·FC_WS_EVENT_BYTES.
+ */
+void encodeEventsHeader(uint8_t* out, uint8_t nLanes, uint32_t firstSeq,
+                        uint32_t ts_ms, uint16_t nEvents);
+void encodeEventRecord(uint8_t* out, uint8_t lane, uint32_t ts_ms);
+
+// ── Little-endian helpers (shared by the other binary encoders) ─────────
+inline void putLe16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8);
+}
+inline void putLe32(uint8_t* p, uint32_t v) {
+  p[0] = (uint8_t)v;         p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24);
+}
+inline uint16_t getLe16(const uint8_t* p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+inline uint32_t getLe32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+         ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
@@ -0,0 +1,73 @@
+"""
+embed_index.py — Embed web/index.html into the firmware as a C header.
+
+Runs as a PlatformIO pre-build script (extra_scripts = pre:scripts/embed_index.py)
+or standalone (python scripts/embed_index.py).  Generates include/index_html.h
+with:
+  * INDEX_HTML      the page as plain text (fallback for clients without gzip)
+  * INDEX_HTML_GZ   a gzip-compressed copy, plus its compile-time length
+  * INDEX_HTML_ETAG a strong ETag derived from the page content
+The header is only rewritten when its content changes, so unchanged pages
+don't trigger a rebuild.
+"""
+import gzip
+import hashlib
+import os
+
+try:
+    Import("env")  # noqa: F821  (provided by PlatformIO / SCons)
+    PROJECT_DIR = env.subst("$PROJECT_DIR")  # noqa: F821
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+SRC = os.path.join(PROJECT_DIR, "web", "index.html")
+OUT = os.path.join(PROJECT_DIR, "include", "index_html.h")
+
+
+def c_bytes(data, per_line=16):
+    lines = []
+    for i in range(0, len(data), per_line):
+        lines.append("  " + ",".join("0x%02x" % b for b in data[i:i + per_line]) + ",")
+    return "\n".join(lines)
+
+
+def main():
+    with open(SRC, "rb") as f:
+        html = f.read()
+
+    # mtime=0 keeps the output byte-identical for identical input
+    gz = gzip.compress(html, compresslevel=9, mtime=0)
+    etag = hashlib.sha1(html).hexdigest()[:16]
+
+    text = html.decode("utf-8")
+    if ")rawliteral" in text:
+        raise SystemExit("index.html must not contain ')rawliteral'")
+
+    header = f"""// Generated by scripts/embed_index.py from web/index.html — do not edit.
+#pragma once
+#include <Arduino.h>
+
+#define INDEX_HTML_ETAG "\\"{etag}\\""
+
+static const char INDEX_HTML[] PROGMEM = R"rawliteral({text})rawliteral";
+static const size_t INDEX_HTML_LEN = sizeof(INDEX_HTML) - 1;
+
+static const uint8_t INDEX_HTML_GZ[] PROGMEM = {{
+{c_bytes(gz)}
+}};
+static const size_t INDEX_HTML_GZ_LEN = sizeof(INDEX_HTML_GZ);   // {len(gz)} bytes (from {len(html)})
+"""
+
+    old = None
+    if os.path.exists(OUT):
+        with open(OUT, "r", encoding="utf-8") as f:
+            old = f.read()
+    if old != header:
+        os.makedirs(os.path.dirname(OUT), exist_ok=True)
+        with open(OUT, "w", encoding="utf-8") as f:
+            f.write(header)
+        print(f"[embed_index] {os.path.relpath(OUT, PROJECT_DIR)}: "
+              f"{len(html)} B page, {len(gz)} B gzip, ETag {etag}")
+
+
+main()
@@ -1,82 +1,256 @@
+/*******************************************************************************
+ * Practice-Station Ball Counter (single lane, 16×2 LCD)
+ * ────────────────────────────────────────────────────────────────────────────
+ * Board   : Arduino UNO R4 WiFi   —   pio run -e ball_counter -t upload
+ * Sensor  : 1× VL53L0X ToF directly on SDA/SCL (no mux)
+ * Display : 16×2 character LCD on a PCF8574 I2C backpack (0x27)
+ * Switch  : D2 HIGH = counting, LOW = backlight off + count reset
+ *
+ * Counts with the same lib/fuel_counter code as the hub: the empty-lane
+ * baseline is calibrated every time the switch is turned on, thresholds
+ * come from calculateThresholds() and every sample goes through
+ * processLaneReading().  The loop never blocks — the sensor ranges
+ * back-to-back and a sample is only fetched when one is ready — and the
+ * LCD is only written when what it shows has changed.
+ *
+ * ── Wiring Notes ─────────────────────────────────────────────────────────
+ *  Arduino UNO R4 WiFi         VL53L0X / LCD backpack
+ *    SDA  (A4 / D18)  ──────►  SDA (both)
+ *    SCL  (A5 / D19)  ──────►  SCL (both)
+ *    5 V               ──────►  VCC (both)
+ *    GND               ──────►  GND (both)
+ *    D2                ◄──────  enable switch (external pull-down)
+ ******************************************************************************/
+
+#include <Arduino.h>
 #include <Wire.h>
 #include <LiquidCrystal_I2C.h>
-#include <VL53L0X.h>
+#include <VL53L0X.h>               // Pololu VL53L0X library
+#include "fuel_counter.h"           // shared lane state machine
+#include "ranging_profile.h"       // VL53L0X timing-budget / VCSEL presets
+#include "calibration.h"           // median/MAD baseline estimation
+
+// ═══════════════════════════════════════════════════════════════════════════
+//  CONFIGURATION — tweak these as needed
+// ═══════════════════════════════════════════════════════════════════════════
+
+static const uint8_t  LCD_ADDR             = 0x27;
+static const uint8_t  SWITCH_PIN           = 2;
+
+// Detection — same meaning as on the hub (see src/main.cpp).
+static const uint16_t DETECTION_DELTA_MM   = 80;    // mm below baseline = ball
+static const uint16_t CLEAR_HYSTERESIS_MM  = 30;    // mm of hysteresis band
+static const uint32_t LOCKOUT_MS           = 60;    // post-count dead time (ms)
+
+// Stations with nothing behind the lane read "out of range" while empty,
+// so calibration has no wall to measure.  They fall back to this baseline,
+// which puts the threshold at the old sketch's fixed 150 mm.
+static const uint16_t FALLBACK_BASELINE_MM = 150 + DETECTION_DELTA_MM;
+
+// 50 Hz ranging; the old 33 ms budget + delay(50) missed fast balls.
+static const RangingProfile RANGING        = RangingProfile::HIGH_SPEED;
+
+static const uint32_t CALIB_TIMEOUT_MS     = 1000;  // give up waiting for a wall
+static const uint32_t SENSOR_TIMEOUT_MS    = 500;   // no sample → re-init
+static const uint32_t SENSOR_RETRY_MS      = 1000;  // between init attempts
+static const uint32_t SWITCH_DEBOUNCE_MS   = 20;
 
-LiquidCrystal_I2C lcd(0x27, 16, 2);
+// ═══════════════════════════════════════════════════════════════════════════
+//  GLOBALS
+// ═══════════════════════════════════════════════════════════════════════════
+
+LiquidCrystal_I2C lcd(LCD_ADDR, 16, 2);
 VL53L0X sensor;
-int switchPin = 2;
+Lane    lane;
+LaneCalibrator<16> calib;
+uint32_t totalBalls    = 0;          // == lane.count; resetLanes() wants one
 
-int numBalls = 0;
-bool ballInView = false; // Tracks if a ball is currently in front of the sensor
+enum class Mode : uint8_t { OFF, SENSOR_FAIL, TIMEOUT, CALIBRATING, COUNTING };
 
-void setup() {
-  Wire.begin();
-  Serial.begin(9600);
+Mode     mode          = Mode::OFF;
+bool     armed         = false;      // debounced switch state
+bool     switchRaw     = false;
+uint32_t switchEdgeMs  = 0;
+uint32_t lastSampleMs  = 0;
+uint32_t lastInitMs    = 0;
+uint32_t calibStartMs  = 0;
 
-  pinMode(2, INPUT);
+// What the LCD currently shows; redraws only touch what differs.
+bool     lcdValid      = false;      // false → full redraw
+Mode     shownMode     = Mode::OFF;
+uint32_t shownCount    = 0;
+bool     lcdLit        = true;
 
-  // 1. Start LCD first
-  lcd.init();
-  lcd.backlight();
-  lcd.print("LCD OK...");
-  delay(500); // Wait for power to stabilize after backlight turns on
-
-  // 2. Initialize Sensor
-  sensor.setTimeout(500);
-  if (!sensor.init()) {
-    // If it fails here, the LCD and Sensor are likely fighting for the bus
-    lcd.setCursor(0,1);
-    lcd.print("Sensor Fail!");
-    while (1); 
+// ═══════════════════════════════════════════════════════════════════════════
+//  SENSOR
+// ═══════════════════════════════════════════════════════════════════════════
+
+bool initSensor() {
+  const RangingParams& rp = rangingParams(RANGING);
+  sensor.setTimeout(SENSOR_TIMEOUT_MS);
+  if (!sensor.init()) return false;
+  bool ok = sensor.setSignalRateLimit(rp.signalRateLimit_mcps);
+  ok &= sensor.setVcselPulsePeriod(VL53L0X::VcselPeriodPreRange,   rp.preRangeVcsel_pclks);
+  ok &= sensor.setVcselPulsePeriod(VL53L0X::VcselPeriodFinalRange, rp.finalRangeVcsel_pclks);
+  ok &= sensor.setMeasurementTimingBudget(rp.timingBudget_us);
+  if (!ok) return false;
+  sensor.startContinuous();          // back-to-back conversions
+  return true;
+}
+
+// Fetch a finished measurement if there is one.  Unlike
+// readRangeContinuousMillimeters() this never waits for the conversion.
+bool pollSample(uint16_t& dist) {
+  if ((sensor.readReg(VL53L0X::RESULT_INTERRUPT_STATUS) & 0x07) == 0) return false;
+  dist = sensor.readReg16Bit(VL53L0X::RESULT_RANGE_STATUS + 10);
+  sensor.writeReg(VL53L0X::SYSTEM_INTERRUPT_CLEAR, 0x01);
+  return true;
+}
+
+// Keeps the count: a sensor re-init after a timeout recalibrates too.
+void startCalibration(uint32_t now) {
+  calib.begin();
+  lane.state   = LaneState::IDLE;
+  lastSampleMs = now;
+  calibStartMs = now;
+  mode = Mode::CALIBRATING;
+}
+
+void finishCalibration() {
+  uint16_t baseline = 0, mad = 0;
+  uint8_t  inliers  = 0;
+  if (!calib.result(baseline, mad, inliers) ||
+      baseline <= DETECTION_DELTA_MM + CLEAR_HYSTERESIS_MM) {
+    baseline = FALLBACK_BASELINE_MM;
   }
-  
-  sensor.startContinuous();
-  lcd.clear();
+  calculateThresholds(lane, baseline, DETECTION_DELTA_MM, CLEAR_HYSTERESIS_MM);
+  Serial.print("Baseline ");
+  Serial.print(baseline);
+  Serial.print(" mm, threshold ");
+  Serial.print(lane.threshold_mm);
+  Serial.println(" mm");
+  mode = Mode::COUNTING;
 }
 
-void loop() {
-  int distance = sensor.readRangeContinuousMillimeters();
-
-  if(digitalRead(switchPin) == HIGH) {
-    lcd.backlight();
-    lcd.setCursor(0, 0);
-    lcd.print("All Systems Go");
-    lcd.setCursor(0, 1);
-    lcd.print("Balls: " + String(numBalls));
-    checkIfBallDetected(distance);
-  } else {
-    lcd.noBacklight();
-    numBalls = 0;
-    ballInView = false;
-    lcd.clear();
+// Runs only while the switch is on.
+void serviceSensor(uint32_t now) {
+  if (!lane.sensorOk) {
+    if (now - lastInitMs < SENSOR_RETRY_MS) return;
+    lastInitMs = now;
+    lane.sensorOk = initSensor();
+    if (!lane.sensorOk) { mode = Mode::SENSOR_FAIL; return; }
+    startCalibration(now);
+    return;
+  }
+
+  uint16_t dist;
+  bool fresh = pollSample(dist);
+  if (mode == Mode::CALIBRATING &&
+      ((fresh && calib.add(dist)) || now - calibStartMs >= CALIB_TIMEOUT_MS)) {
+    finishCalibration();
+    return;
+  }
+  if (!fresh) {
+    if (now - lastSampleMs >= SENSOR_TIMEOUT_MS) {
+      Serial.println("TIMEOUT");
+      lane.sensorOk = false;          // re-init on the next retry slot
+      lastInitMs    = now;
+      mode          = Mode::TIMEOUT;
+    }
+    return;
   }
+  lastSampleMs         = now;
+  lane.lastDistance_mm = dist;
 
-  // Check for sensor timeout/error
-  if (sensor.timeoutOccurred()) { 
-    Serial.println("TIMEOUT"); 
+  if (mode == Mode::CALIBRATING || dist == 0) return;   // 0 = no valid range
+
+  if (processLaneReading(lane, dist, now, LOCKOUT_MS)) {
+    Serial.print("Ball Detected! Total: ");
+    Serial.println(lane.count);
   }
+}
+
+// ═══════════════════════════════════════════════════════════════════════════
+//  SWITCH & DISPLAY
+// ═══════════════════════════════════════════════════════════════════════════
 
-  delay(50); // Faster polling to catch quick-moving balls
+void serviceSwitch(uint32_t now) {
+  bool raw = digitalRead(SWITCH_PIN) == HIGH;
+  if (raw != switchRaw) { switchRaw = raw; switchEdgeMs = now; }
+  if (raw == armed || now - switchEdgeMs < SWITCH_DEBOUNCE_MS) return;
+
+  armed = raw;
+  if (!armed) {
+    resetLanes(&lane, 1, totalBalls);
+    mode = Mode::OFF;
+  } else if (lane.sensorOk) {
+    startCalibration(now);             // lane is empty when switched on
+  } else {
+    mode = Mode::SENSOR_FAIL;
+  }
 }
 
-void checkIfBallDetected(int aDistance) {
-  // --- Detection Logic ---
-  // If object is closer than 75mm and we haven't counted it yet
-  if (aDistance > 0 && aDistance < 150 && !ballInView) {
-    ballInView = true;
-    numBalls++;
-    
-    // Update LCD
-    lcd.setCursor(7, 1);
-    lcd.print("   "); // Clear old digits
+void serviceDisplay() {
+  if (!lcdValid || mode != shownMode) {
+    bool lit = mode != Mode::OFF;
+    if (lit != lcdLit) {
+      if (lit) lcd.backlight(); else lcd.noBacklight();
+      lcdLit = lit;
+    }
+    lcd.clear();
+    switch (mode) {
+      case Mode::OFF:         break;
+      case Mode::SENSOR_FAIL: lcd.print("Sensor Fail!");   break;
+      case Mode::TIMEOUT:     lcd.print("Sensor Timeout"); break;
+      case Mode::CALIBRATING: lcd.print("Calibrating..."); break;
+      case Mode::COUNTING:    lcd.print("All Systems Go"); break;
+    }
+    if (mode == Mode::COUNTING) {
+      lcd.setCursor(0, 1);
+      lcd.print("Balls: ");
+    }
+    shownMode = mode;
+    lcdValid  = true;
+    if (mode == Mode::COUNTING) shownCount = lane.count + 1;   // force digits
+  }
+
+  if (mode == Mode::COUNTING && lane.count != shownCount) {
+    // Counts only grow while counting (a reset goes through OFF and a full
+    // redraw), so the new number always covers the old one.
+    char buf[11];
+    snprintf(buf, sizeof(buf), "%lu", (unsigned long)lane.count);
     lcd.setCursor(7, 1);
-    lcd.print(numBalls);
-    
-    Serial.print("Ball Detected! Total: ");
-    Serial.println(numBalls);
-  } 
-  // Reset the trigger once the ball clears the sensor (distance > 85mm)
-  else if (aDistance > 150 && ballInView) {
-    ballInView = false;
+    lcd.print(buf);
+    shownCount = lane.count;
   }
-}
\ No newline at end of file
+}
+
+// ═══════════════════════════════════════════════════════════════════════════
+//  SETUP & LOOP
+// ═══════════════════════════════════════════════════════════════════════════
+
+void setup() {
+  Wire.begin();
+  Serial.begin(9600);
+  pinMode(SWITCH_PIN, INPUT);
+
+  lcd.init();
+  lcd.backlight();
+  lcd.print("LCD OK...");
+
+  uint32_t now  = millis();
+  lastInitMs    = now;
+  lane.sensorOk = initSensor();
+  if (!lane.sensorOk) Serial.println("Sensor Fail!");
+  switchRaw     = digitalRead(SWITCH_PIN) == HIGH;
+  armed         = switchRaw;
+  if (armed) mode = lane.sensorOk ? Mode::CALIBRATING : Mode::SENSOR_FAIL;
+  if (mode == Mode::CALIBRATING) startCalibration(now);
+}
+
+void loop() {
+  uint32_t now = millis();
+  serviceSwitch(now);
+  if (armed) serviceSensor(now);
+  serviceDisplay();
+}
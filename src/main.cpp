@@ -4,6 +4,7 @@
  * Board   : Arduino UNO R4 WiFi  (Renesas RA4M1)
  * Network : Access-Point mode – SSID "HUB_COUNTER" / password "12345678"
  * Sensors : 4× VL53L0X ToF (I2C) behind a TCA9548A I2C multiplexer
+ *           (FC_LANE_COUNT=8/16 … adds lanes; one extra mux per 8 lanes)
  * Web UI  : HTTP on port 80 + WebSocket on port 81
  *
  * ── Wiring Notes ─────────────────────────────────────────────────────────
@@ -19,6 +20,15 @@
  *  TCA9548A channel 2  ──────► VL53L0X  Lane 3
  *  TCA9548A channel 3  ──────► VL53L0X  Lane 4
  *
+ *  Optional (FC_USE_LANE_IRQ=1): VL53L0X GPIO1 of lanes 1–4 → D2, D3, D8,
+ *  D12 for interrupt-driven data-ready instead of register polling.
+ *
+ *  Optional (FC_USE_SAMPLE_TIMER=1): no wiring — an RA4M1 hardware timer
+ *  paces the sensor service and keeps network work out of sample deadlines.
+ *
+ *  Optional (FC_USE_XSHUT=1): no mux — all sensors share SDA/SCL directly
+ *  and XSHUT of lanes 1–4 → D4, D5, D6, D7 for address assignment at boot.
+ *
  *  Most VL53L0X breakout boards (Adafruit, Pololu, generic) have on-board
  *  regulators and level-shifters, so they are safe on 3.3 V or 5 V.
  *  The TCA9548A itself runs at 3.3 V; its I/O is 3.3 V-tolerant (matches
@@ -32,10 +42,33 @@
 
 #include <Arduino.h>
 #include <Wire.h>
+#include <EEPROM.h>                // R4: emulated on the 8 KB data flash
 #include <WiFiS3.h>
 #include <UnoR4WiFi_WebServer.h>   // DIYables – includes WebSocket support
 #include <VL53L0X.h>               // Pololu VL53L0X library
 #include "fuel_counter.h"           // Extracted state-machine & counting logic
+#include "ranging_profile.h"       // VL53L0X timing-budget / VCSEL presets
+#include "lane_map.h"              // lane → mux / channel
+#include "json_writer.h"           // heap-free JSON into fixed buffers
+#include "ws_protocol.h"           // binary snapshot / delta frames
+#include "count_log.h"             // sequenced count events for resume
+#include "index_html.h"            // generated from web/index.html
+#include "histogram.h"             // fixed-bucket latency histograms
+#include "trace_codec.h"           // raw distance trace blocks
+#include "stored_config.h"         // calibration image kept in EEPROM
+#include "calibration.h"           // median/MAD baseline estimation
+#include "log_ring.h"              // deferred Serial log output
+#include "ws_command.h"            // {"cmd":…} dispatch table
+#include "lane_health.h"           // offline detection + hot recovery
+#include "sample_filter.h"         // status / signal / median-of-3 filter
+#include "count_bins.h"            // per-lane counts in time bins (GET /bins)
+#include "hub_link.h"              // hub → aggregator UDP count datagrams
+#include "telemetry.h"             // raw-sample UDP datagrams (diagnostics)
+#include <stdarg.h>
+#include <atomic>                  // ISR → loop() lane-ready mask
+#if FC_USE_SAMPLE_TIMER
+#include <FspTimer.h>              // R4 core: GPT/AGT timer wrapper
+#endif
 
 // ═══════════════════════════════════════════════════════════════════════════
 //  CONFIGURATION — tweak these as needed
@@ -45,9 +78,43 @@
 static const char AP_SSID[]     = "HUB_COUNTER";
 static const char AP_PASSWORD[] = "12345678";        // must be ≥8 chars
 
+// ── Multi-hub aggregation ───────────────────────────────────────────────
+// FC_HUB_ROLE selects how this hub sits on the network:
+//   0  standalone   own AP, own scoreboard (default)
+//   1  aggregator   own AP; also folds the UDP reports of other hubs into a
+//                   combined total on its WebSocket ({"cmd":"hubs",…})
+//   2  reporter     joins the aggregator's AP (AP_SSID) as a station and
+//                   sends its counts to it by UDP on every change, plus a
+//                   heartbeat every HUB_HEARTBEAT_MS
+// Give every hub of a set its own -DFC_HUB_ID=0..7.  Any hub can be built
+// as the aggregator; its own lanes count as hub FC_HUB_ID.
+#define FC_HUB_STANDALONE 0
+#define FC_HUB_AGGREGATOR 1
+#define FC_HUB_REPORTER   2
+#ifndef FC_HUB_ROLE
+#define FC_HUB_ROLE FC_HUB_STANDALONE
+#endif
+#ifndef FC_HUB_ID
+#define FC_HUB_ID 0
+#endif
+static_assert(FC_HUB_ID < FC_MAX_HUBS, "FC_HUB_ID must be 0..7");
+static_assert(FC_NUM_LANES <= FC_HUB_MAX_LANES, "too many lanes for a hub datagram");
+static const uint16_t HUB_UDP_PORT         = 4210;
+static const uint32_t HUB_HEARTBEAT_MS     = 500;
+static const uint32_t HUB_STALE_MS         = 2000;  // no report → hub shown offline
+static const uint32_t HUB_RECONNECT_MS     = 10000; // reporter: first rejoin retry …
+static const uint32_t HUB_RECONNECT_MAX_MS = 60000; // … doubling up to this
+static const uint32_t HUB_LINK_CHECK_MS    = 1000;  // WiFi.status() is a bridge round trip
+// WiFiS3 has no asynchronous join: WiFi.begin() blocks until it connects
+// or times out.  A reporter that lost the AP therefore only rejoins once
+// every lane has been idle (no ball in a beam, no count) this long.
+static const uint32_t HUB_REJOIN_QUIET_MS  = 3000;
+static const uint8_t  HUB_RX_PER_LOOP      = 4;     // datagrams drained per pass
+static const uint32_t HUB_BROADCAST_MIN_MS = 50;
+
 // ── Sensor / counting parameters ────────────────────────────────────────
 static const uint8_t  NUM_LANES            = FC_NUM_LANES;
-static const uint8_t  TCA9548A_ADDR        = 0x70;  // default mux address
+static const uint8_t  TCA9548A_ADDR        = 0x70;  // first mux; lanes 9–16 on 0x71 …
 
 // Detection: a ball is "present" when the measured distance drops below
 // (baseline − DETECTION_DELTA_MM).  The hysteresis band prevents chatter
@@ -56,9 +123,196 @@ static const uint8_t  TCA9548A_ADDR        = 0x70;  // default mux address
 static const uint16_t DETECTION_DELTA_MM   = 80;    // mm below baseline = ball
 static const uint16_t CLEAR_HYSTERESIS_MM  = 30;    // mm of hysteresis band
 static const uint32_t LOCKOUT_MS           = 60;    // post-count dead time (ms)
-static const uint8_t  CALIB_SAMPLES        = 20;    // samples for baseline avg
+
+// Adaptive lockout: each lane's dead time follows its measured ball dwell
+// (beam-blocked time) — LOCKOUT_DWELL_PCT % of the smoothed dwell, clamped
+// to [LOCKOUT_MIN_MS, LOCKOUT_MAX_MS].  LOCKOUT_MS applies until a lane's
+// first count.  Set LOCKOUT_DWELL_PCT = 0 for a fixed LOCKOUT_MS.
+static const uint8_t  LOCKOUT_DWELL_PCT    = 50;
+static const uint16_t LOCKOUT_MIN_MS       = 15;    // tight streams
+static const uint16_t LOCKOUT_MAX_MS       = 120;   // slow rollers
+static const uint16_t BALL_DIAMETER_MM     = 150;   // for the speed estimate
+
+// Multi-ball: balls touching each other never let the distance clear, so
+// one pass can be up to MAX_BALLS_PER_PASS balls, inferred from separate
+// dips (MULTI_BALL_DIP_MM rise between them) or from an occupancy much
+// longer than the lane's single-ball dwell.  1 = one count per pass.
+static const uint8_t  MAX_BALLS_PER_PASS   = 3;
+static const uint16_t MULTI_BALL_DIP_MM    = 20;
+
+// Baseline drift: while a lane is idle and clearly empty its baseline
+// follows the readings (EMA weight 1/2^BASELINE_DRIFT_SHIFT), moving at
+// most BASELINE_DRIFT_STEP_Q8/256 mm per sample (~1 mm/s at 30 Hz) and no
+// more than BASELINE_DRIFT_LIMIT_MM from calibration.  Readings beyond
+// BASELINE_DRIFT_WINDOW_MM of the baseline are ignored.  Shift 0 = off.
+static const uint8_t  BASELINE_DRIFT_SHIFT     = 6;
+static const uint16_t BASELINE_DRIFT_STEP_Q8   = 8;
+static const uint16_t BASELINE_DRIFT_WINDOW_MM = 25;
+static const uint16_t BASELINE_DRIFT_LIMIT_MM  = 60;
+static const uint8_t  CALIB_SAMPLES        = 20;    // samples per lane (median/MAD)
+static const uint16_t CALIB_MAX_MAD_MM     = 8;     // noisier → resample
+static const uint8_t  CALIB_MAX_TRIES      = 3;     // windows per lane
+static const uint32_t CALIB_TIMEOUT_MS     = 3000;  // lanes = parallel, so flat
 static const uint16_t SENSOR_TIMEOUT_MS    = 50;    // per-read timeout (ms)
 
+// Hot recovery: a lane that misses LANE_OFFLINE_TIMEOUTS sample deadlines
+// in a row (one per SENSOR_TIMEOUT_MS past its timing budget) is taken
+// offline, then re-initialised and recalibrated from loop() one short step
+// at a time.  Failed attempts back off from RECOVERY_RETRY_MIN_MS up to
+// RECOVERY_RETRY_MAX_MS.
+static const uint8_t  LANE_DEGRADE_TIMEOUTS = 3;
+static const uint8_t  LANE_OFFLINE_TIMEOUTS = 20;   // ~1 s of silence
+static const uint16_t RECOVERY_STEP_GAP_MS  = 10;   // settle between steps
+static const uint32_t RECOVERY_RETRY_MIN_MS = 500;
+static const uint32_t RECOVERY_RETRY_MAX_MS = 30000;
+
+// ── Sample filter ───────────────────────────────────────────────────────
+// With FC_SAMPLE_FILTER=1 each result is fetched in one burst with its
+// range status and signal rate; invalid or weak readings are dropped and
+// the rest pass a median-of-3 before counting, so single stray shorts
+// can't count a ball.  This is what makes the noisy "fast" profile usable.
+// Build with -DFC_SAMPLE_FILTER=0 for the bare 2-byte range read.
+#ifndef FC_SAMPLE_FILTER
+#define FC_SAMPLE_FILTER 1
+#endif
+// Each lane's signal floor is FILTER_SIGNAL_FLOOR_PCT % of its ranging
+// profile's own signal-rate limit (≈0.15 MCPS for fast/default, 0.06 for
+// long), so LONG_RANGE keeps the weak returns it lowers the limit to get.
+// 0 turns the signal check off.
+static const bool     FILTER_MEDIAN           = true;
+static const uint8_t  FILTER_SIGNAL_FLOOR_PCT = 60;
+
+// Ranging profile every lane boots with.  Override per build, e.g.
+// -DFC_DEFAULT_PROFILE=RangingProfile::HIGH_SPEED, or per lane at runtime
+// over the WebSocket: {"cmd":"profile","lane":2,"p":"fast"}  (lane 0 = all)
+#ifndef FC_DEFAULT_PROFILE
+#define FC_DEFAULT_PROFILE RangingProfile::STANDARD
+#endif
+
+// ── Optional data-ready interrupts ──────────────────────────────────────
+// Wire each VL53L0X GPIO1 to an interrupt-capable R4 pin and build with
+// -DFC_USE_LANE_IRQ=1.  The sensor pulls GPIO1 low when a sample is ready;
+// the ISR queues the lane and loop() services it immediately.  Lanes whose
+// pin is LANE_IRQ_NONE (or builds without the flag) are polled instead.
+#ifndef FC_USE_LANE_IRQ
+#define FC_USE_LANE_IRQ 0
+#endif
+static const uint8_t  LANE_IRQ_NONE        = 0xFF;
+static const uint8_t  LANE_IRQ_PINS[]      = { 2, 3, 8, 12 };  // GPIO1 → pin
+
+// ── Timer-paced sampling ────────────────────────────────────────────────
+// -DFC_USE_SAMPLE_TIMER=1 ticks a free GPT/AGT channel at SAMPLE_TICK_HZ.
+// Each tick, loop() checks only the polled lanes whose next sample is due
+// (one profile timing budget after the last), and samples are stamped with
+// the time they were read, so lockout timing no longer stretches with
+// network load.  HTTP / WebSocket servicing runs only when the nearest lane
+// deadline is at least NET_SLOT_MS away (but never waits more than
+// NET_MAX_DEFER_MS).  Interrupt lanes are always stamped in their ISR.
+#ifndef FC_USE_SAMPLE_TIMER
+#define FC_USE_SAMPLE_TIMER 0
+#endif
+static const uint32_t SAMPLE_TICK_HZ       = 1000;
+static const uint32_t NET_SLOT_MS          = 3;     // typical handleClient() pass
+static const uint32_t NET_MAX_DEFER_MS     = 25;
+
+// ── Mux-free addressing ────────────────────────────────────────────────
+// Build with -DFC_USE_XSHUT=1 to drop the TCA9548A: every sensor's XSHUT
+// goes to its own pin, the sensors are released from reset one at a time
+// and each is moved to TOF_ADDR_BASE + lane before the next one wakes up.
+#ifndef FC_USE_XSHUT
+#define FC_USE_XSHUT 0
+#endif
+static const uint8_t  LANE_XSHUT_PINS[]    = { 4, 5, 6, 7 };   // XSHUT ← pin
+static const uint8_t  TOF_ADDR_BASE        = 0x30;  // lane n → 0x30 + n
+static const uint32_t BUS_STATS_INTERVAL_MS = 5000; // I2C rate report period
+
+// ── Reconnect / resume ──────────────────────────────────────────────────
+// The last COUNT_LOG_SIZE count events are kept so a reconnecting client
+// can send {"cmd":"resume","seq":N} and get only what it missed.  New
+// clients that don't resume within SNAPSHOT_GRACE_MS get a full snapshot.
+static const uint16_t COUNT_LOG_SIZE        = 256;   // power of two
+static const uint32_t SNAPSHOT_GRACE_MS     = 250;
+
+// ── Loop instrumentation ────────────────────────────────────────────────
+// micros()-based histograms per loop stage, per-lane sample interval and
+// count→send latency, served as JSON from GET /metrics.  Each read returns
+// the window since the previous read.  -DFC_METRICS=0 compiles it all out.
+#ifndef FC_METRICS
+#define FC_METRICS 1
+#endif
+
+// ── Logging ─────────────────────────────────────────────────────────────
+// Runtime messages are formatted into a RAM ring and trickled out to Serial
+// from loop() only while the UART TX buffer has room and no sensor work is
+// waiting, so a burst of counts never waits on 115200 baud.  Lines that
+// don't fit are dropped and counted.  FC_LOG_LEVEL: 0 off, 1 error,
+// 2 warn, 3 info, 4 debug (echoes every WebSocket message).
+#ifndef FC_LOG_LEVEL
+#define FC_LOG_LEVEL 3
+#endif
+static const uint16_t LOG_RING_BYTES        = 2048;  // power of two
+static const uint8_t  LOG_LINE_MAX          = 96;    // longer lines are cut
+static const uint16_t LOG_DRAIN_MAX_BYTES   = 64;    // per loop() pass
+
+// ── Boot ────────────────────────────────────────────────────────────────
+// setup() only brings the sensors up.  Calibration, the Wi-Fi AP and the
+// servers follow as stages driven from loop(), so lanes count before the
+// network exists.  The ESP32-S3 bridge boots on its own after reset; by
+// the time beginAP() asks for the AP, most of that wait is already over.
+// The AP stage waits for calibration because beginAP() still blocks for
+// whatever is left.  Nothing waits for a Serial monitor: boot lines sit
+// in the log ring, held back for SERIAL_ATTACH_MS so that a monitor
+// opened at reset still catches them.
+static const uint32_t SERIAL_ATTACH_MS     = 1500;
+static const uint32_t AP_RETRY_MS          = 5000;  // after a failed beginAP()
+
+// ── Stored calibration / warm start ─────────────────────────────────────
+// Baselines, thresholds, ranging profiles and the lane map are saved to
+// EEPROM after calibration.  A valid image skips the cold calibration at
+// boot; each lane's first WARM_CHECK_SAMPLES readings are then compared
+// with its stored baseline and the lane is recalibrated in place if they
+// differ by more than WARM_CHECK_TOLERANCE_MM.
+static const int      CONFIG_EEPROM_ADDR      = 0;
+static const uint8_t  CONFIG_WIRING           = FC_USE_XSHUT ? FC_WIRING_XSHUT : FC_WIRING_MUX;
+static const uint8_t  WARM_CHECK_SAMPLES      = 10;
+static const uint16_t WARM_CHECK_TOLERANCE_MM = 25;
+static const uint16_t WARM_CHECK_SPREAD_MM    = 15;  // else a ball went by; retry
+
+// ── Raw distance trace capture ──────────────────────────────────────────
+// Every sample can be streamed as delta-encoded TRACE blocks for offline
+// replay (tools/replay).  Turn it on per WebSocket client with
+// {"cmd":"trace","on":1}, or down Serial with {"cmd":"trace","serial":1};
+// -DFC_TRACE_SERIAL=1 starts the Serial capture at boot.
+#ifndef FC_TRACE_SERIAL
+#define FC_TRACE_SERIAL 0
+#endif
+static const size_t   TRACE_BLOCK_BYTES     = 256;   // one WS frame per block
+static const uint32_t TRACE_FLUSH_MS        = 100;   // max age of a partial block
+
+// ── Raw sample telemetry over UDP ───────────────────────────────────────
+// {"cmd":"telemetry","on":1,"port":4211} streams every sample of every
+// lane (distance, time, state, range status) to the asking client's IP as
+// one datagram per TELEMETRY_PERIOD_MS, on its own channel so scoring
+// updates never queue behind it.  Stops on {"on":0} or when that client
+// disconnects.  -DFC_TELEMETRY=0 drops the two datagram buffers.
+#ifndef FC_TELEMETRY
+#define FC_TELEMETRY 1
+#endif
+static const uint16_t TELEMETRY_UDP_PORT       = 4211;  // default destination port
+static const uint32_t TELEMETRY_PERIOD_MS      = 50;
+static const size_t   TELEMETRY_DATAGRAM_BYTES = 1400;  // fits one Ethernet MTU
+
+// ── Scoring-rate history (GET /bins) ────────────────────────────────────
+// Counts are kept per lane in COUNT_BIN_BYTES of 1-byte time bins, enough
+// for COUNT_HISTORY_MS at 100 ms bins on up to 4 lanes; with more lanes
+// the bins widen (in 100 ms steps) to keep the same span.  A full reset
+// starts a new history.
+static const uint32_t COUNT_HISTORY_MS = 180000;     // one match
+static const uint32_t COUNT_BIN_BYTES  = 7200;
+static const uint16_t COUNT_BINS   = (uint16_t)(COUNT_BIN_BYTES / NUM_LANES < COUNT_HISTORY_MS / 100
+                                                ? COUNT_BIN_BYTES / NUM_LANES : COUNT_HISTORY_MS / 100);
+static const uint16_t COUNT_BIN_MS = (uint16_t)((COUNT_HISTORY_MS / COUNT_BINS + 99) / 100 * 100);
+
 // ═══════════════════════════════════════════════════════════════════════════
 //  GLOBALS
 // ═══════════════════════════════════════════════════════════════════════════
@@ -66,382 +320,2012 @@ static const uint16_t SENSOR_TIMEOUT_MS    = 50;    // per-read timeout (ms)
 // ── Sensor objects ──────────────────────────────────────────────────────
 VL53L0X tof[NUM_LANES];                       // one object per lane (reused via mux)
 
-// ── Per-lane state (uses Lane struct from fuel_counter.h) ───────────────
-Lane lanes[NUM_LANES];
+// ── Lane wiring (mux / channel) ─────────────────────────────────────────
+LaneWiring laneWiring[NUM_LANES];
+uint8_t    muxCount = 0;                      // muxes in use
+
+// ── Per-lane state (structure-of-arrays LaneBank from fuel_counter.h) ──
+LaneBank<NUM_LANES> bank;
+static const uint32_t ALL_LANES_MASK = LaneBank<NUM_LANES>::ALL_MASK;
 uint32_t totalCount = 0;
+RangingProfile laneProfile[NUM_LANES];        // active VL53L0X preset per lane
+
+// ── Data-ready events (ISR producers, loop() consumer) ─────────────────
+// One bit per lane, set with an atomic OR, so any number of pin ISRs at
+// any priorities can post without ordering between them; loop() takes the
+// whole mask with one exchange.  The stamp is written before the bit.
+std::atomic<uint32_t> laneReadyMask{0};
+uint32_t lastSampleMs[NUM_LANES] = {};       // capture time of the last sample
+volatile uint32_t laneReadyMs[NUM_LANES] = {}; // GPIO1 edge time (ISR)
+
+// ── Sampling tick (FC_USE_SAMPLE_TIMER) ─────────────────────────────────
+#if FC_USE_SAMPLE_TIMER
+FspTimer          sampleTimer;
+bool              sampleTimerOn     = false;  // a timer channel was free
+volatile bool     sampleTickPending = false;
+#endif
+uint32_t          lastNetMs         = 0;      // last pass that served the network
 
 // ── Network / server ────────────────────────────────────────────────────
 UnoR4WiFi_WebServer server(80);
 UnoR4WiFi_WebSocket* ws = nullptr;
 
+// ── Connected WebSocket clients and their negotiated protocol ───────────
+static const uint8_t MAX_WS_CLIENTS = 8;
+struct WsClientSlot {
+  net::WebSocket* sock   = nullptr;           // nullptr = free slot
+  bool            binary = false;             // sent {"cmd":"proto","bin":1}
+  bool            snapshotPending = false;    // owed a snapshot (unless it resumes)
+  bool            trace  = false;             // sent {"cmd":"trace","on":1}
+  uint32_t        snapshotDueMs   = 0;
+  // Count fan-out: changes pile up here until the client is due again
+  bool            changed     = false;        // owed an update
+  uint32_t        dirty       = 0;            // lanes changed since its last delta
+  uint32_t        seq         = 0;            // its delta sequence number
+  uint16_t        interval_ms = 0;            // {"cmd":"rate"}; 0 = default
+  uint16_t        backoff_ms  = 0;            // added while it is falling behind
+  uint32_t        lastSendMs  = 0;
+  bool            countUnsent   = false;      // owed at least one new count
+  uint32_t        oldestCountMs = 0;          // capture time of the oldest one
+};
+WsClientSlot wsClients[MAX_WS_CLIENTS];
+
 // ── Change-broadcast throttle ───────────────────────────────────────────
+// Each client gets at most one update per interval (BROADCAST_MIN_INTERVAL_MS
+// unless it asked for slower with {"cmd":"rate","hz":N}).  A send that
+// blocks for WS_SLOW_SEND_US marks that client as behind: its updates are
+// coalesced behind a backoff that doubles up to WS_MAX_BACKOFF_MS and
+// decays on fast sends, and one pass never spends more than
+// WS_SEND_BUDGET_US before handing the loop back to the sensors.
 bool     countsChanged   = true;              // send on first client connect
-uint32_t lastBroadcastMs = 0;
+uint32_t dirtyLanes      = 0;                 // lanes changed since last hand-off
+// Every update carries the age of the oldest count in it (capture → send),
+// so the page can measure sensor-to-screen latency end to end.
+bool     countPending    = false;             // a count since the last hand-off
+uint32_t pendingCountMs  = 0;                 // capture time of the oldest one
+uint32_t lastCountMs     = 0;                 // capture time of the newest count
 static const uint32_t BROADCAST_MIN_INTERVAL_MS = 50;  // max ~20 updates/s
+static const uint32_t BROADCAST_MAX_INTERVAL_MS = 10000;
+static const uint32_t WS_SLOW_SEND_US      = 8000;
+static const uint16_t WS_MAX_BACKOFF_MS    = 2000;
+static const uint32_t WS_SEND_BUDGET_US    = 15000;
+uint8_t  wsSendCursor   = 0;                  // round-robin start
+uint32_t wsSlowSends    = 0;                  // metrics
+uint32_t wsCoalesced    = 0;                  // updates folded into a later one
+
+// ── Multi-hub link (FC_HUB_ROLE) ────────────────────────────────────────
+#if FC_HUB_ROLE != FC_HUB_STANDALONE
+WiFiUDP  hubUdp;
+static uint8_t hubBuf[hubCountsMax(FC_HUB_MAX_LANES)];
+bool     hubLocalChanged = true;             // local counts changed since last report
+uint32_t lastHubTxMs     = 0;
+#endif
+#if FC_HUB_ROLE == FC_HUB_AGGREGATOR
+HubTable hubTable;                            // remote hubs' last reports
+bool     hubsChanged      = false;            // combined view needs a push
+uint8_t  hubsOnline       = 0;                // last onlineMask()
+uint32_t lastHubsSendMs   = 0;
+#elif FC_HUB_ROLE == FC_HUB_REPORTER
+uint32_t hubSeq           = 0;
+uint16_t hubBootId        = 0;
+uint32_t lastJoinMs       = 0;
+uint32_t rejoinGapMs      = HUB_RECONNECT_MS;
+uint32_t lastLinkCheckMs  = 0;
+bool     hubLinkUp        = false;            // last WiFi.status() result
+#endif
+
+// ── Raw telemetry channel (FC_TELEMETRY) ───────────────────────────────
+#if FC_TELEMETRY
+TelemetryDoubleBuffer<TELEMETRY_DATAGRAM_BYTES> telemetry(NUM_LANES);
+WiFiUDP         telemetryUdp;
+bool            telemetryUdpOpen = false;
+IPAddress       telemetryDest;
+uint16_t        telemetryPort    = 0;
+net::WebSocket* telemetryOwner   = nullptr;  // client that asked; nullptr = off
+#endif
+
+// ── Count event history (for resume-from-sequence) ──────────────────────
+CountLog<COUNT_LOG_SIZE> countLog;
+uint32_t laneResetSeq = 0;                    // first seq after the latest lane reset
+CountBins<NUM_LANES, COUNT_BINS> countBins;   // scoring-rate history
+
+// ── I2C bus accounting ──────────────────────────────────────────────────
+// Counts the transactions issued from the sampling path (mux selects,
+// status polls, result reads) so the Serial report shows bus load.
+uint32_t i2cTransactions  = 0;
+uint32_t lastBusReportMs  = 0;
+uint32_t lastBusReportTx  = 0;
+
+// ── Trace capture ───────────────────────────────────────────────────────
+// Double-buffered: the sample path fills the front block while the sealed
+// back block is sent from the idle point in loop().
+uint8_t      traceBuf[2][TRACE_BLOCK_BYTES];
+TraceEncoder traceEnc[2] = {
+  TraceEncoder(traceBuf[0], TRACE_BLOCK_BYTES, NUM_LANES),
+  TraceEncoder(traceBuf[1], TRACE_BLOCK_BYTES, NUM_LANES),
+};
+uint8_t      traceFront     = 0;              // encoder taking samples
+size_t       traceReadyLen  = 0;              // sealed back block, 0 = none
+bool         traceWsSent    = false;          // back block went to WS clients
+size_t       traceSerialOff = 0;              // bytes of it already down Serial
+uint32_t     traceDropped   = 0;              // samples lost, both blocks busy
+bool         traceSerial = FC_TRACE_SERIAL;   // stream blocks down Serial
+bool         traceOn     = FC_TRACE_SERIAL;   // any sink active
+
+// ── Stored configuration ────────────────────────────────────────────────
+StoredConfig  storedConfig;
+bool          warmStart       = false;        // booted from a valid image
+bool          configDirty     = false;        // save from loop()
+uint32_t      warmCheckMask   = 0;            // lanes still being checked
+BaselineCheck warmCheck[NUM_LANES];
+
+// ── Boot stages (see serviceBoot()) ─────────────────────────────────────
+enum class BootStage : uint8_t { CALIBRATE, NETWORK, SERVERS, READY };
+BootStage bootStage   = BootStage::CALIBRATE;
+uint32_t  apRetryAtMs = 0;
+
+// millis() at each boot milestone; 0 = not reached yet
+struct BootTimes {
+  uint32_t sensorsMs    = 0;   // every sensor initialised (or given up on)
+  uint32_t countingMs   = 0;   // first sample through the counter
+  uint32_t apMs         = 0;   // Access Point up / aggregator joined
+  uint32_t readyMs      = 0;   // HTTP + WebSocket serving
+  uint32_t firstBallMs  = 0;   // first ball counted
+};
+BootTimes boot;
+
+inline bool networkUp() { return bootStage == BootStage::READY; }
+
+// ── Baseline calibration (all lanes in parallel) ────────────────────────
+LaneCalibrator<CALIB_SAMPLES> calib[NUM_LANES];
+uint32_t calibMask    = 0;                    // lanes currently calibrating
+uint32_t calibStartMs = 0;                    // first lane of the current run
+uint32_t calibLaneStartMs[NUM_LANES] = {};    // per-lane timeout origin
+uint8_t  calibTries[NUM_LANES] = {};
+
+// ── Sensor sample bookkeeping ───────────────────────────────────────────
+uint32_t laneTimeouts[NUM_LANES]  = {};      // missed sample deadlines
+uint32_t lastTimeoutMs[NUM_LANES] = {};      // millis() of the last one
+
+// ── Sample filter (FC_SAMPLE_FILTER) ────────────────────────────────────
+#if FC_SAMPLE_FILTER
+SampleFilterBank<NUM_LANES> sampleFilter;
+uint8_t  laneRangeStatus[NUM_LANES] = {};    // RESULT_RANGE_STATUS of last read
+uint16_t laneSignal[NUM_LANES]      = {};    // its signal rate, MCPS 9.7
+#endif
+
+// ── Sensor health / hot recovery ────────────────────────────────────────
+static const LaneHealthConfig LANE_HEALTH_CFG = {
+  LANE_DEGRADE_TIMEOUTS, LANE_OFFLINE_TIMEOUTS, RECOVERY_STEP_GAP_MS,
+  RECOVERY_RETRY_MIN_MS, RECOVERY_RETRY_MAX_MS, FC_USE_XSHUT != 0
+};
+LaneHealthMonitor laneHealth[NUM_LANES];
+uint8_t           recoveryCursor = 0;          // round-robin over lanes
+
+// ── Loop metrics (FC_METRICS) ───────────────────────────────────────────
+#if FC_METRICS
+enum MetricStage : uint8_t {
+  STAGE_LOOP, STAGE_HTTP, STAGE_WS, STAGE_SENSORS, STAGE_BROADCAST, NUM_STAGES
+};
+static const char* const HEALTH_NAMES[] = { "ok", "degraded", "offline", "recovering" };
+static const char* const STAGE_NAMES[NUM_STAGES] = {
+  "loop", "http", "ws", "sensors", "broadcast"
+};
+struct LoopMetrics {
+  Histogram stage[NUM_STAGES];                // µs spent per loop() stage
+  Histogram laneInterval[NUM_LANES];          // µs between samples per lane
+  Histogram countToSend;                      // µs from ball clear to WS send
+  uint32_t  lastSampleUs[NUM_LANES] = {};
+  uint32_t  oldestUnsentUs = 0;               // micros() of first unsent count
+  bool      unsent         = false;
+  uint32_t  windowStartMs  = 0;
+};
+LoopMetrics metrics;
+#define METRIC_START(t)       uint32_t t = micros()
+#define METRIC_STOP(hist, t)  (hist).record(micros() - (t))
+#else
+#define METRIC_START(t)       do {} while (0)
+#define METRIC_STOP(hist, t)  do {} while (0)
+#endif
+
+// ── Deferred log output ─────────────────────────────────────────────────
+LogRing<LOG_RING_BYTES> logRing;
+
+// ── Forward declarations (defined further down) ─────────────────────────
+bool applyRangingProfile(uint8_t ch, RangingProfile profile);
+void beginCalibration(uint32_t mask);
+bool updateLane(uint8_t ch, uint16_t& dist);
+void serviceLaneEvents();
+
+// ═══════════════════════════════════════════════════════════════════════════
+//  LOGGING
+// ═══════════════════════════════════════════════════════════════════════════
+
+// Format one line (newline added) into the log ring; never blocks.
+void logLine(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+void logLine(const char* fmt, ...) {
+  char line[LOG_LINE_MAX];
+  // Say how much was lost once there is room to say it
+  if (logRing.free() >= 2 * LOG_LINE_MAX) {
+    uint32_t lost = logRing.takeUnreported();
+    if (lost) {
+      int n = snprintf(line, sizeof(line), "[Log] %lu line(s) dropped\n", (unsigned long)lost);
+      logRing.push(line, (uint16_t)n);
+    }
+  }
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(line, sizeof(line) - 1, fmt, ap);
+  va_end(ap);
+  if (n < 0) return;
+  if (n > (int)sizeof(line) - 2) n = sizeof(line) - 2;
+  line[n++] = '\n';
+  logRing.push(line, (uint16_t)n);
+}
+
+// Move up to budget queued bytes to Serial without blocking.
+void logDrain(uint16_t budget) {
+  if (millis() < SERIAL_ATTACH_MS) return;   // boot lines wait for a monitor
+  if (traceSerialOff) return;                // don't split a trace block
+  while (budget) {
+    int room = Serial.availableForWrite();
+    const char* p;
+    uint16_t n = logRing.peek(p);
+    if (room <= 0 || !n) return;
+    if (n > room)   n = room;
+    if (n > budget) n = budget;
+    Serial.write((const uint8_t*)p, n);
+    logRing.consume(n);
+    budget -= n;
+  }
+}
+
+#if FC_LOG_LEVEL >= 1
+#define LOG_ERROR(...) logLine(__VA_ARGS__)
+#else
+#define LOG_ERROR(...) ((void)0)
+#endif
+#if FC_LOG_LEVEL >= 2
+#define LOG_WARN(...)  logLine(__VA_ARGS__)
+#else
+#define LOG_WARN(...)  ((void)0)
+#endif
+#if FC_LOG_LEVEL >= 3
+#define LOG_INFO(...)  logLine(__VA_ARGS__)
+#else
+#define LOG_INFO(...)  ((void)0)
+#endif
+#if FC_LOG_LEVEL >= 4
+#define LOG_DEBUG(...) logLine(__VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#endif
 
 // ═══════════════════════════════════════════════════════════════════════════
 //  TCA9548A MULTIPLEXER HELPER
 // ═══════════════════════════════════════════════════════════════════════════
 
-void muxSelect(uint8_t channel) {
-  if (channel > 7) return;
-  Wire.beginTransmission(TCA9548A_ADDR);
-  Wire.write(1 << channel);
-  Wire.endTransmission();
-}
-
-// ═══════════════════════════════════════════════════════════════════════════
-//  HTML PAGE (stored in PROGMEM to save RAM)
-// ═══════════════════════════════════════════════════════════════════════════
-
-static const char INDEX_HTML[] PROGMEM = R"rawliteral(
-<!DOCTYPE html>
-<html lang="en">
-<head>
-<meta charset="UTF-8">
-<meta name="viewport" content="width=device-width,initial-scale=1">
-<title>Hub Fuel Counter</title>
-<style>
-*{box-sizing:border-box;margin:0;padding:0}
-body{font-family:'Segoe UI',system-ui,sans-serif;background:#111;color:#eee;
-     display:flex;flex-direction:column;align-items:center;min-height:100vh;padding:20px}
-h1{font-size:1.4rem;margin-bottom:8px;color:#aaa;text-transform:uppercase;letter-spacing:2px}
-#total{font-size:6rem;font-weight:700;color:#0f0;text-shadow:0 0 30px #0f0;margin:10px 0}
-.lanes{display:flex;gap:16px;flex-wrap:wrap;justify-content:center;margin:20px 0}
-.lane{background:#1a1a1a;border:2px solid #333;border-radius:12px;padding:20px 30px;
-      min-width:120px;text-align:center;transition:border-color .3s}
-.lane.error{border-color:#f44}
-.lane-label{font-size:.85rem;color:#888;margin-bottom:4px}
-.lane-count{font-size:2.8rem;font-weight:700;color:#4fc3f7}
-.lane-count.error{color:#f44}
-#status{margin:18px 0;padding:6px 18px;border-radius:20px;font-size:.85rem;font-weight:600}
-#status.ok{background:#1b5e20;color:#69f0ae}
-#status.err{background:#b71c1c;color:#ff8a80}
-button{background:#1565c0;color:#fff;border:none;padding:12px 36px;font-size:1rem;
-       border-radius:8px;cursor:pointer;margin-top:10px;transition:background .2s}
-button:hover{background:#1976d2}
-button:active{background:#0d47a1}
-.ts{color:#555;font-size:.75rem;margin-top:12px}
-</style>
-</head>
-<body>
-<h1>Hub Fuel Counter</h1>
-<div id="total">0</div>
-<div class="lanes">
-  <div class="lane" id="l1box"><div class="lane-label">Lane 1</div><div class="lane-count" id="l1">0</div></div>
-  <div class="lane" id="l2box"><div class="lane-label">Lane 2</div><div class="lane-count" id="l2">0</div></div>
-  <div class="lane" id="l3box"><div class="lane-label">Lane 3</div><div class="lane-count" id="l3">0</div></div>
-  <div class="lane" id="l4box"><div class="lane-label">Lane 4</div><div class="lane-count" id="l4">0</div></div>
-</div>
-<div id="status" class="err">Disconnected</div>
-<button onclick="doReset()">Reset Counts</button>
-<div class="ts" id="ts"></div>
-<script>
-var ws,reconDelay=1000;
-function connect(){
-  var host=location.hostname;
-  ws=new WebSocket('ws://'+host+':81');
-  ws.onopen=function(){
-    document.getElementById('status').className='ok';
-    document.getElementById('status').textContent='Connected';
-    reconDelay=1000;
-    ws.send(JSON.stringify({cmd:'ping'}));
-  };
-  ws.onclose=function(){
-    document.getElementById('status').className='err';
-    document.getElementById('status').textContent='Disconnected';
-    setTimeout(connect,reconDelay);
-    reconDelay=Math.min(reconDelay*2,8000);
-  };
-  ws.onerror=function(){ws.close();};
-  ws.onmessage=function(ev){
-    try{
-      var d=JSON.parse(ev.data);
-      if(d.cmd==='pong') return;
-      if('total' in d){
-        document.getElementById('total').textContent=d.total;
-        for(var i=1;i<=4;i++){
-          var el=document.getElementById('l'+i);
-          var box=document.getElementById('l'+i+'box');
-          if(d['s'+i]===false){
-            el.textContent='ERR';
-            el.className='lane-count error';
-            box.className='lane error';
-          } else {
-            el.textContent=d['l'+i];
-            el.className='lane-count';
-            box.className='lane';
-          }
-        }
-        if(d.ts) document.getElementById('ts').textContent='Uptime: '+(d.ts/1000).toFixed(1)+'s';
-      }
-    }catch(e){}
-  };
+// Lane currently routed through the mux chain (0xFF = unknown, force a write).
+static uint8_t muxLane = 0xFF;
+
+// Write a channel mask to one mux; returns true if it acknowledged.
+static bool muxWrite(uint8_t muxAddr, uint8_t channelMask) {
+  Wire.beginTransmission(muxAddr);
+  Wire.write(channelMask);
+  i2cTransactions++;
+  return Wire.endTransmission() == 0;
 }
-function doReset(){
-  if(ws&&ws.readyState===1) ws.send(JSON.stringify({cmd:'reset'}));
+
+// Route the bus to a lane's sensor (see laneWiring[]).
+void muxSelect(uint8_t lane) {
+#if FC_USE_XSHUT
+  (void)lane;                         // every sensor has its own address
+#else
+  if (lane >= NUM_LANES) return;
+  if (lane == muxLane) return;        // already routed — skip the bus write
+  const LaneWiring& w = laneWiring[lane];
+  // Every sensor answers at 0x29, so close the other muxes before opening one
+  if (muxLane != 0xFF && laneWiring[muxLane].mux != w.mux) {
+    muxWrite(TCA9548A_ADDR + laneWiring[muxLane].mux, 0);
+  } else if (muxLane == 0xFF) {
+    for (uint8_t m = 0; m < muxCount; m++) {
+      if (m != w.mux) muxWrite(TCA9548A_ADDR + m, 0);
+    }
+  }
+  // Only trust the cache if the mux acknowledged the write
+  muxLane = muxWrite(TCA9548A_ADDR + w.mux, 1 << w.channel) ? lane : 0xFF;
+#endif
 }
-connect();
-</script>
-</body>
-</html>
-)rawliteral";
+
+// ═══════════════════════════════════════════════════════════════════════════
+//  HTML PAGE
+// ═══════════════════════════════════════════════════════════════════════════
+//
+//  The page source lives in web/index.html.  scripts/embed_index.py (run by
+//  PlatformIO before every build) turns it into include/index_html.h with a
+//  plain copy, a gzip copy (INDEX_HTML_GZ, ~2.3 kB instead of ~5.3 kB), their
+//  compile-time lengths and a content-hash ETag.
 
 // ═══════════════════════════════════════════════════════════════════════════
 //  HTTP ROUTE HANDLER  –  GET /
 // ═══════════════════════════════════════════════════════════════════════════
 
+static const size_t HTTP_CHUNK_BYTES = 1436;  // one TCP segment per write
+
+// True if the raw request head contains "<name>: …<value>…" on one line.
+// The DIYables server passes the request head (request line + headers) in
+// the `request` argument; header names are matched case-insensitively.
+static bool requestHeaderContains(const String& request, const char* name,
+                                  const char* value)
+{
+  const char* head = request.c_str();
+  size_t nameLen = strlen(name);
+  for (const char* line = head; *line; ) {
+    const char* eol = strchr(line, '\n');
+    size_t len = eol ? (size_t)(eol - line) : strlen(line);
+    if (len > nameLen && line[nameLen] == ':' && strncasecmp(line, name, nameLen) == 0) {
+      const char* v = line + nameLen + 1;
+      size_t vlen = strlen(value);
+      for (; v + vlen <= line + len; v++) {
+        if (strncmp(v, value, vlen) == 0) return true;
+      }
+      return false;
+    }
+    if (!eol) break;
+    line = eol + 1;
+  }
+  return false;
+}
+
+// Write a flash-resident body in TCP-segment-sized pieces (no RAM copy).
+static void writeBody(WiFiClient& client, const uint8_t* data, size_t len) {
+  for (size_t i = 0; i < len; i += HTTP_CHUNK_BYTES) {
+    size_t n = len - i < HTTP_CHUNK_BYTES ? len - i : HTTP_CHUNK_BYTES;
+    client.write(data + i, n);
+  }
+}
+
 void handleRoot(WiFiClient& client,
                 const String& method,
                 const String& request,
                 const QueryParams& params,
                 const String& jsonData)
 {
-  // Send the PROGMEM page.  sendResponse expects a const char* in RAM,
-  // so we stream it manually to avoid a huge RAM copy.
-  client.println(F("HTTP/1.1 200 OK"));
-  client.println(F("Content-Type: text/html; charset=UTF-8"));
-  client.println(F("Connection: close"));
-  client.println();
+  // Unchanged page → 304 with no body; the reload costs one tiny write
+  if (requestHeaderContains(request, "If-None-Match", INDEX_HTML_ETAG)) {
+    client.print(F("HTTP/1.1 304 Not Modified\r\n"
+                   "ETag: " INDEX_HTML_ETAG "\r\n"
+                   "Cache-Control: no-cache\r\n"
+                   "Connection: close\r\n\r\n"));
+    return;
+  }
+
+  bool gzip = requestHeaderContains(request, "Accept-Encoding", "gzip");
+
+  // Whole header in one write; lengths are compile-time constants
+  char head[256];
+  int n = snprintf(head, sizeof(head),
+                   "HTTP/1.1 200 OK\r\n"
+                   "Content-Type: text/html; charset=UTF-8\r\n"
+                   "%s"
+                   "Content-Length: %u\r\n"
+                   "ETag: " INDEX_HTML_ETAG "\r\n"
+                   "Cache-Control: no-cache\r\n"
+                   "Vary: Accept-Encoding\r\n"
+                   "Connection: close\r\n\r\n",
+                   gzip ? "Content-Encoding: gzip\r\n" : "",
+                   (unsigned)(gzip ? INDEX_HTML_GZ_LEN : INDEX_HTML_LEN));
+  client.write((const uint8_t*)head, (size_t)n);
+
+  if (gzip) writeBody(client, INDEX_HTML_GZ, INDEX_HTML_GZ_LEN);
+  else      writeBody(client, (const uint8_t*)INDEX_HTML, INDEX_HTML_LEN);
+}
+
+// ═══════════════════════════════════════════════════════════════════════════
+//  HTTP ROUTE HANDLER  –  GET /metrics  (FC_METRICS)
+// ═══════════════════════════════════════════════════════════════════════════
+
+#if FC_METRICS
+// ~110 chars per histogram object, plus lane/timeout framing and totals
+static const size_t METRICS_JSON_MAX = 313 + 80 * FC_MAX_HUBS + 110 * (NUM_STAGES + NUM_LANES + 1) + 106 * NUM_LANES;
+static char metricsJsonBuf[METRICS_JSON_MAX];
+
+// "key":{"n":…,"min":…,"p50":…,"p99":…,"max":…}
+static void writeHistogram(JsonWriter& j, const char* key, const Histogram& h) {
+  j.beginObject(key)
+   .field("n", h.count()).field("min", h.min())
+   .field("p50", h.percentile(50)).field("p99", h.percentile(99))
+   .field("max", h.max())
+   .endObject();
+}
 
-  // Stream from PROGMEM in small chunks
-  const uint16_t chunkSize = 256;
-  uint16_t len = strlen_P(INDEX_HTML);
-  for (uint16_t i = 0; i < len; i += chunkSize) {
-    char buf[chunkSize + 1];
-    uint16_t n = min((uint16_t)chunkSize, (uint16_t)(len - i));
-    memcpy_P(buf, INDEX_HTML + i, n);
-    buf[n] = '\0';
-    client.print(buf);
+void handleMetrics(WiFiClient& client,
+                   const String& method,
+                   const String& request,
+                   const QueryParams& params,
+                   const String& jsonData)
+{
+  uint32_t now = millis();
+  JsonWriter j(metricsJsonBuf, sizeof(metricsJsonBuf));
+  j.beginObject();
+  j.field("window_ms", now - metrics.windowStartMs);
+  j.field("i2c_tx", i2cTransactions);
+  j.field("log_dropped", logRing.dropped());
+  j.field("trace_dropped", traceDropped);
+  j.field("ws_slow_sends", wsSlowSends);
+  j.field("ws_coalesced", wsCoalesced);
+  j.beginObject("boot_ms")
+   .field("sensors", boot.sensorsMs).field("counting", boot.countingMs)
+   .field("ap", boot.apMs).field("ready", boot.readyMs)
+   .field("first_ball", boot.firstBallMs)
+   .endObject();
+#if FC_TELEMETRY
+  j.field("telemetry_dropped", telemetry.dropped());
+#endif
+#if FC_HUB_ROLE == FC_HUB_AGGREGATOR
+  j.beginArray("hubs");
+  for (uint8_t id = 0; id < FC_MAX_HUBS; id++) {
+    const HubEntry& h = hubTable.hub(id);
+    if (!h.known) continue;
+    j.beginObject().field("id", (uint32_t)id + 1).field("rx", h.rx).field("lost", h.lost)
+     .field("age_ms", now - h.lastRxMs).endObject();
+  }
+  j.endArray();
+#endif
+  j.beginObject("stages_us");
+  for (uint8_t s = 0; s < NUM_STAGES; s++) writeHistogram(j, STAGE_NAMES[s], metrics.stage[s]);
+  j.endObject();
+  writeHistogram(j, "count_to_send_us", metrics.countToSend);
+  j.beginArray("lanes");
+  for (uint8_t ch = 0; ch < NUM_LANES; ch++) {
+    j.beginObject();
+    writeHistogram(j, "interval_us", metrics.laneInterval[ch]);
+    j.field("timeouts", laneTimeouts[ch]);
+    j.field("health", HEALTH_NAMES[(uint8_t)laneHealth[ch].health()]);
+    j.field("recoveries", (uint32_t)laneHealth[ch].recoveries());
+    j.field("recovery_failures", (uint32_t)laneHealth[ch].failures());
+#if FC_SAMPLE_FILTER
+    j.field("rejected", sampleFilter.rejected[ch]);
+#endif
+    j.field("dwell_ms", bank.dwell(ch));
+    j.field("lockout_ms", bank.lockout_ms[ch]);
+    j.field("speed_mm_s", bank.speed(ch, BALL_DIAMETER_MM));
+    j.field("multi_passes", bank.multiPasses[ch]);
+    j.field("baseline_mm", (uint32_t)bank.baseline_mm[ch]);
+    j.field("cal_baseline_mm", (uint32_t)bank.calBaseline_mm[ch]);
+    j.field("last_conf", (uint32_t)bank.lastConfidence[ch]);
+    j.endObject();
   }
+  j.endArray();
+  j.endObject();
+
+  char head[128];
+  int n = snprintf(head, sizeof(head),
+                   "HTTP/1.1 200 OK\r\n"
+                   "Content-Type: application/json\r\n"
+                   "Content-Length: %u\r\n"
+                   "Cache-Control: no-store\r\n"
+                   "Connection: close\r\n\r\n",
+                   (unsigned)j.length());
+  client.write((const uint8_t*)head, (size_t)n);
+  client.write((const uint8_t*)j.c_str(), j.length());
+
+  // Start a fresh window so every read reflects only recent behaviour
+  for (uint8_t s = 0; s < NUM_STAGES; s++) metrics.stage[s].reset();
+  for (uint8_t ch = 0; ch < NUM_LANES; ch++) metrics.laneInterval[ch].reset();
+  metrics.countToSend.reset();
+  metrics.windowStartMs = now;
+}
+#endif
+
+// ═══════════════════════════════════════════════════════════════════════════
+//  HTTP ROUTE HANDLER  –  GET /bins  (scoring-rate history)
+// ═══════════════════════════════════════════════════════════════════════════
+//
+//  ?since=N   only bins after bin N (the dashboard polls incrementally)
+//  ?fmt=bin   packed u8 counts (layout in count_bins.h); default is CSV
+//
+//  The body is streamed with chunked transfer encoding from one static
+//  chunk buffer, so an export of any length never builds a String.
+
+// Value of "key=" in the request line's query string (not NUL-terminated).
+static const char* requestQuery(const String& request, const char* key, size_t& len) {
+  const char* line = request.c_str();
+  const char* end  = strchr(line, '\n');
+  if (!end) end = line + strlen(line);
+  const char* q = (const char*)memchr(line, '?', end - line);
+  size_t keyLen = strlen(key);
+  while (q && q < end) {
+    q++;
+    if ((size_t)(end - q) > keyLen && strncmp(q, key, keyLen) == 0 && q[keyLen] == '=') {
+      const char* v = q + keyLen + 1;
+      len = strcspn(v, "& \r\n");
+      return v;
+    }
+    q = (const char*)memchr(q, '&', end - q);
+  }
+  return nullptr;
+}
+
+static const size_t CHUNK_HEAD_BYTES  = 5;      // "5a2\r\n"
+static const size_t CHUNK_PAYLOAD_MAX = HTTP_CHUNK_BYTES - CHUNK_HEAD_BYTES - 2;
+static uint8_t chunkBuf[HTTP_CHUNK_BYTES];
+static size_t  chunkLen = 0;                    // payload bytes buffered
+
+// Send the buffered payload as one chunk (one write), then drain any
+// sensor interrupts that queued up meanwhile.
+static void chunkFlush(WiFiClient& client) {
+  if (!chunkLen) return;
+  static const char HEX_DIGITS[] = "0123456789abcdef";
+  chunkBuf[0] = HEX_DIGITS[(chunkLen >> 8) & 0xF];
+  chunkBuf[1] = HEX_DIGITS[(chunkLen >> 4) & 0xF];
+  chunkBuf[2] = HEX_DIGITS[chunkLen & 0xF];
+  chunkBuf[3] = '\r';
+  chunkBuf[4] = '\n';
+  chunkBuf[CHUNK_HEAD_BYTES + chunkLen]     = '\r';
+  chunkBuf[CHUNK_HEAD_BYTES + chunkLen + 1] = '\n';
+  client.write(chunkBuf, CHUNK_HEAD_BYTES + chunkLen + 2);
+  chunkLen = 0;
+  serviceLaneEvents();
+}
+
+static void chunkPut(WiFiClient& client, const void* data, size_t len) {
+  const uint8_t* p = (const uint8_t*)data;
+  while (len) {
+    size_t n = CHUNK_PAYLOAD_MAX - chunkLen;
+    if (n > len) n = len;
+    memcpy(chunkBuf + CHUNK_HEAD_BYTES + chunkLen, p, n);
+    chunkLen += n;
+    p   += n;
+    len -= n;
+    if (chunkLen == CHUNK_PAYLOAD_MAX) chunkFlush(client);
+  }
+}
+
+static void chunkEnd(WiFiClient& client) {
+  chunkFlush(client);
+  client.write((const uint8_t*)"0\r\n\r\n", 5);
+}
+
+void handleBins(WiFiClient& client,
+                const String& method,
+                const String& request,
+                const QueryParams& params,
+                const String& jsonData)
+{
+  countBins.advance(millis());
+  uint32_t first = countBins.oldest();
+  size_t len;
+  const char* v = requestQuery(request, "since", len);
+  if (v) {
+    uint32_t since = strtoul(v, nullptr, 10);
+    if (since + 1 > first) first = since + 1;
+  }
+  uint32_t last = countBins.newest();
+  uint16_t nBins = first <= last ? (uint16_t)(last - first + 1) : 0;
+  v = requestQuery(request, "fmt", len);
+  bool binary = v && len == 3 && strncmp(v, "bin", 3) == 0;
+
+  char head[160];
+  int n = snprintf(head, sizeof(head),
+                   "HTTP/1.1 200 OK\r\n"
+                   "Content-Type: %s\r\n"
+                   "Transfer-Encoding: chunked\r\n"
+                   "Cache-Control: no-store\r\n"
+                   "Connection: close\r\n\r\n",
+                   binary ? "application/octet-stream" : "text/csv");
+  client.write((const uint8_t*)head, (size_t)n);
+  chunkLen = 0;
+
+  if (binary) {
+    uint8_t hdr[FC_COUNT_BINS_HEADER_BYTES];
+    hdr[0] = FC_WS_MAGIC;
+    hdr[1] = FC_COUNT_BINS_TYPE;
+    hdr[2] = NUM_LANES;
+    hdr[3] = 0;
+    putLe32(hdr + 4, first);
+    putLe32(hdr + 8, countBins.origin());
+    putLe16(hdr + 12, countBins.binMs());
+    putLe16(hdr + 14, nBins);
+    chunkPut(client, hdr, sizeof(hdr));
+    for (uint16_t k = 0; k < nBins; k++) chunkPut(client, countBins.row(first + k), NUM_LANES);
+  } else {
+    // # bin_ms=100 origin_ms=1234
+    // bin,t_ms,l1,…,lN        (t_ms = millis() at the start of the bin)
+    char row[48 + 4 * NUM_LANES];
+    int r = snprintf(row, sizeof(row), "# bin_ms=%u origin_ms=%lu\nbin,t_ms",
+                     countBins.binMs(), (unsigned long)countBins.origin());
+    chunkPut(client, row, (size_t)r);
+    for (uint8_t ch = 0; ch < NUM_LANES; ch++) {
+      r = snprintf(row, sizeof(row), ",l%u", ch + 1);
+      chunkPut(client, row, (size_t)r);
+    }
+    chunkPut(client, "\n", 1);
+    for (uint16_t k = 0; k < nBins; k++) {
+      uint32_t bin = first + k;
+      const uint8_t* counts = countBins.row(bin);
+      r = snprintf(row, sizeof(row), "%lu,%lu", (unsigned long)bin,
+                   (unsigned long)(countBins.origin() + bin * countBins.binMs()));
+      for (uint8_t ch = 0; ch < NUM_LANES; ch++) {
+        r += snprintf(row + r, sizeof(row) - r, ",%u", counts[ch]);
+      }
+      row[r++] = '\n';
+      chunkPut(client, row, (size_t)r);
+    }
+  }
+  chunkEnd(client);
 }
 
 // ═══════════════════════════════════════════════════════════════════════════
 //  JSON HELPERS
 // ═══════════════════════════════════════════════════════════════════════════
 
-// Build the JSON status string that is sent to all WS clients.
-String buildCountsJson() {
-  // {"l1":0,"l2":0,"l3":0,"l4":0,"total":0,"s1":true,..."ts":12345}
-  String j = "{";
+// Worst-case payload size, from the longest value each field can take:
+//   {"n":32,                                         8
+//   "l32":4294967295,"s32":false,   × NUM_LANES     29 each
+//   "total":4294967295,"eseq":4294967295,           37
+//   "age":4294967295,                               17
+//   "ts":4294967295}                                16  (+ NUL)
+static const size_t COUNTS_JSON_MAX = 8 + 29 * NUM_LANES + 37 + 17 + 16 + 1;
+static char countsJsonBuf[COUNTS_JSON_MAX];
+
+// ms from a count's capture to now (a stamp taken after now counts as 0).
+static uint32_t countAgeMs(uint32_t captureMs, uint32_t now) {
+  int32_t age = (int32_t)(now - captureMs);
+  return age > 0 ? (uint32_t)age : 0;
+}
+
+// Build the JSON status message that is sent to all WS clients.  Written
+// into a static buffer (no heap); valid until the next call.
+// oldestCountMs: capture time of the oldest count the client hasn't seen
+// (adds "age"), or nullptr.
+const char* buildCountsJson(const uint32_t* oldestCountMs = nullptr) {
+  // {"n":4,"l1":0,"s1":true,…,"l4":0,"s4":true,"total":0,"eseq":0,"age":35,"ts":12345}
+  uint32_t now = millis();
+  JsonWriter j(countsJsonBuf, sizeof(countsJsonBuf));
+  j.beginObject();
+  j.field("n", (uint32_t)NUM_LANES);
   for (uint8_t i = 0; i < NUM_LANES; i++) {
-    j += "\"l" + String(i + 1) + "\":" + String(lanes[i].count) + ",";
-    j += "\"s" + String(i + 1) + "\":" + (lanes[i].sensorOk ? "true" : "false") + ",";
+    j.indexedField('l', i + 1, bank.count[i]);
+    j.indexedFlag('s', i + 1, bank.sensorOk(i));
   }
-  j += "\"total\":" + String(totalCount) + ",";
-  j += "\"ts\":"   + String(millis());
-  j += "}";
-  return j;
+  j.field("total", totalCount);
+  j.field("eseq", countLog.lastSeq());
+  if (oldestCountMs) j.field("age", countAgeMs(*oldestCountMs, now));
+  j.field("ts", now);
+  j.endObject();
+  return j.c_str();
 }
 
 // ═══════════════════════════════════════════════════════════════════════════
 //  WEBSOCKET EVENT HANDLERS
 // ═══════════════════════════════════════════════════════════════════════════
 
-void onWsOpen(net::WebSocket& /* wsClient */) {
-  Serial.println(F("[WS] Client connected"));
-  // Immediately send current state to the new client
-  if (ws) {
-    String payload = buildCountsJson();
-    ws->broadcastTXT(payload);
+static const size_t COUNTS_FRAME_MAX = wsCountsFrameMax(NUM_LANES);
+static uint8_t countsFrameBuf[COUNTS_FRAME_MAX];
+
+// Encode a binary counts frame carrying the lanes in laneMask
+// (oldestCountMs as for buildCountsJson()).
+size_t buildCountsFrame(WsFrameType type, uint32_t laneMask, uint32_t seq,
+                        const uint32_t* oldestCountMs = nullptr) {
+  WsCountsHeader hdr;
+  hdr.type     = type;
+  hdr.nLanes   = NUM_LANES;
+  hdr.seq      = seq;
+  hdr.ts_ms    = millis();
+  hdr.total    = totalCount;
+  hdr.okMask   = bank.okMask;
+  hdr.laneMask = laneMask;
+  hdr.eventSeq = countLog.lastSeq();
+  hdr.hasAge      = oldestCountMs != nullptr;
+  hdr.countAge_ms = hdr.hasAge ? countAgeMs(*oldestCountMs, hdr.ts_ms) : 0;
+  return encodeCountsFrame(countsFrameBuf, sizeof(countsFrameBuf), hdr, bank.count);
+}
+
+void wsSendText(net::WebSocket& sock, const char* text) {
+  sock.send(net::WebSocket::DataType::TEXT, text, strlen(text));
+}
+
+void wsSendBinary(net::WebSocket& sock, const uint8_t* data, size_t len) {
+  sock.send(net::WebSocket::DataType::BINARY, (const char*)data, len);
+}
+
+WsClientSlot* findWsClient(net::WebSocket& sock) {
+  for (uint8_t i = 0; i < MAX_WS_CLIENTS; i++) {
+    if (wsClients[i].sock == &sock) return &wsClients[i];
+  }
+  return nullptr;
+}
+
+#if FC_HUB_ROLE == FC_HUB_AGGREGATOR
+// {"cmd":"hubs","sum":N,"hubs":[[id,total,online],…]}  (ids 1-based,
+// online 1/0; this hub first)
+static char hubsJsonBuf[40 + 32 * FC_MAX_HUBS];
+const char* buildHubsJson() {
+  uint32_t now = millis();
+  JsonWriter j(hubsJsonBuf, sizeof(hubsJsonBuf));
+  // Offline hubs keep their last-known total in the list but not the sum
+  j.beginObject().field("cmd", "hubs")
+   .field("sum", totalCount + hubTable.total(now, HUB_STALE_MS));
+  j.beginArray("hubs");
+  j.beginArray().value((uint32_t)FC_HUB_ID + 1).value(totalCount).value((uint32_t)1).endArray();
+  for (uint8_t id = 0; id < FC_MAX_HUBS; id++) {
+    if (id == FC_HUB_ID || !hubTable.hub(id).known) continue;
+    j.beginArray().value((uint32_t)id + 1).value(hubTable.hub(id).total)
+     .value((uint32_t)hubTable.online(id, now, HUB_STALE_MS)).endArray();
+  }
+  j.endArray().endObject();
+  return j.c_str();
+}
+#endif
+
+// Full state for one client, in whichever protocol it negotiated.  It
+// supersedes any update the client was owed.
+void sendSnapshot(WsClientSlot& client) {
+  const uint32_t* oldest = client.countUnsent ? &client.oldestCountMs : nullptr;
+  client.changed     = false;
+  client.dirty       = 0;
+  client.countUnsent = false;
+  if (client.binary) {
+    size_t len = buildCountsFrame(WsFrameType::SNAPSHOT, ALL_LANES_MASK, client.seq, oldest);
+    if (len) wsSendBinary(*client.sock, countsFrameBuf, len);
+  } else {
+    wsSendText(*client.sock, buildCountsJson(oldest));
+  }
+#if FC_HUB_ROLE == FC_HUB_AGGREGATOR
+  wsSendText(*client.sock, buildHubsJson());
+#endif
+}
+
+// Scratch for resume replies: a full ring's worth of binary event records,
+// also reused as the JSON text buffer (which overflows into a snapshot).
+static uint8_t resumeBuf[FC_WS_EVENTS_HEADER_BYTES + FC_WS_EVENT_BYTES * COUNT_LOG_SIZE];
+
+// Answer {"cmd":"resume","seq":N}: every count event after N in one
+// frame, or a snapshot if the ring no longer reaches back that far.
+void sendResume(WsClientSlot& client, uint32_t afterSeq) {
+  client.snapshotPending = false;
+  // A client from before a lane reset would keep that lane's old count
+  if (!countLog.covers(afterSeq) || afterSeq < laneResetSeq) {
+    sendSnapshot(client);
+    return;
+  }
+  uint32_t first = afterSeq + 1;
+  uint32_t last  = countLog.lastSeq();
+  uint16_t n     = (uint16_t)(last - afterSeq);
+
+  if (client.binary) {
+    encodeEventsHeader(resumeBuf, NUM_LANES, first, millis(), n);
+    uint8_t* p = resumeBuf + FC_WS_EVENTS_HEADER_BYTES;
+    for (uint32_t seq = first; seq <= last; seq++, p += FC_WS_EVENT_BYTES) {
+      uint8_t lane; uint32_t ts;
+      countLog.at(seq, lane, ts);
+      encodeEventRecord(p, lane, ts);
+    }
+    wsSendBinary(*client.sock, resumeBuf, p - resumeBuf);
+    return;
+  }
+
+  // {"cmd":"events","seq":first,"eseq":last,"ev":[[lane,ts],…]}  (lane 1-based)
+  JsonWriter j((char*)resumeBuf, sizeof(resumeBuf));
+  j.beginObject().field("cmd", "events").field("seq", first).field("eseq", last);
+  j.beginArray("ev");
+  for (uint32_t seq = first; seq <= last; seq++) {
+    uint8_t lane; uint32_t ts;
+    countLog.at(seq, lane, ts);
+    j.beginArray().value((uint32_t)lane + 1).value(ts).endArray();
+  }
+  j.endArray().endObject();
+  if (j.overflow()) sendSnapshot(client);   // too many to batch as text
+  else              wsSendText(*client.sock, j.c_str());
+}
+
+// Send snapshots owed to clients that connected without resuming.
+void serviceSnapshotGrace() {
+  uint32_t now = millis();
+  for (uint8_t i = 0; i < MAX_WS_CLIENTS; i++) {
+    WsClientSlot& c = wsClients[i];
+    if (c.sock && c.snapshotPending && (int32_t)(now - c.snapshotDueMs) >= 0) {
+      c.snapshotPending = false;
+      sendSnapshot(c);
+    }
   }
 }
 
-void onWsMessage(net::WebSocket& /* wsClient */,
+// Hand the changes since the last call to every client's pending update.
+void queueCountsForClients() {
+  for (uint8_t i = 0; i < MAX_WS_CLIENTS; i++) {
+    WsClientSlot& c = wsClients[i];
+    if (!c.sock) continue;
+    if (c.changed) wsCoalesced++;
+    c.changed = true;
+    c.dirty  |= dirtyLanes;
+    if (countPending &&
+        (!c.countUnsent || (int32_t)(pendingCountMs - c.oldestCountMs) < 0)) {
+      c.oldestCountMs = pendingCountMs;
+      c.countUnsent   = true;
+    }
+  }
+  dirtyLanes    = 0;
+  countsChanged = false;
+  countPending  = false;
+}
+
+// Send one client its pending update: a delta of its dirty lanes if it
+// speaks binary, else the JSON snapshot.  Adjusts its backoff from how
+// long the send blocked.
+static void sendPendingCounts(WsClientSlot& c, uint32_t now) {
+  uint32_t t0 = micros();
+  const uint32_t* oldest = c.countUnsent ? &c.oldestCountMs : nullptr;
+  if (c.binary) {
+    size_t len = buildCountsFrame(WsFrameType::DELTA, c.dirty, ++c.seq, oldest);
+    if (len) wsSendBinary(*c.sock, countsFrameBuf, len);
+  } else {
+    wsSendText(*c.sock, buildCountsJson(oldest));
+  }
+  uint32_t took = micros() - t0;
+  c.changed     = false;
+  c.dirty       = 0;
+  c.countUnsent = false;
+  c.lastSendMs  = now;
+  if (took >= WS_SLOW_SEND_US) {
+    wsSlowSends++;
+    uint32_t b = c.backoff_ms ? c.backoff_ms * 2u : BROADCAST_MIN_INTERVAL_MS;
+    c.backoff_ms = (uint16_t)(b < WS_MAX_BACKOFF_MS ? b : WS_MAX_BACKOFF_MS);
+  } else {
+    c.backoff_ms /= 2;
+  }
+}
+
+/**
+ * Send pending updates to the clients that are due, round-robin, until
+ * the pass has used WS_SEND_BUDGET_US.  Clients left over keep their
+ * update (coalescing any new changes) and go first next time.
+ * @return true if anything was sent
+ */
+bool serviceBroadcasts(uint32_t now) {
+  uint32_t start = micros();
+  bool     sent  = false;
+  for (uint8_t n = 0; n < MAX_WS_CLIENTS; n++) {
+    uint8_t i = (uint8_t)((wsSendCursor + n) % MAX_WS_CLIENTS);
+    WsClientSlot& c = wsClients[i];
+    if (!c.sock || !c.changed) continue;
+    uint32_t interval = c.interval_ms ? c.interval_ms : BROADCAST_MIN_INTERVAL_MS;
+    if (now - c.lastSendMs < interval + c.backoff_ms) continue;
+    if (sent && micros() - start >= WS_SEND_BUDGET_US) {
+      wsSendCursor = i;                 // out of budget: resume here
+      return true;
+    }
+    sendPendingCounts(c, now);
+    sent = true;
+  }
+  return sent;
+}
+
+void onWsOpen(net::WebSocket& wsClient) {
+  LOG_INFO("[WS] Client connected");
+  WsClientSlot* slot = nullptr;
+  for (uint8_t i = 0; i < MAX_WS_CLIENTS && !slot; i++) {
+    if (!wsClients[i].sock) slot = &wsClients[i];
+  }
+  if (!slot) {
+    LOG_WARN("[WS] Client table full — not tracked");
+    return;
+  }
+  slot->sock   = &wsClient;
+  slot->binary = false;                 // JSON until the client negotiates
+  // Current state follows shortly unless the client resumes from a seq,
+  // so a reconnect storm doesn't turn into a burst of full snapshots
+  slot->snapshotPending = true;
+  slot->snapshotDueMs   = millis() + SNAPSHOT_GRACE_MS;
+}
+
+// Recompute whether any trace sink is active.
+void updateTraceOn() {
+  bool on = traceSerial;
+  for (uint8_t i = 0; i < MAX_WS_CLIENTS; i++) {
+    if (wsClients[i].sock && wsClients[i].trace) on = true;
+  }
+  if (on && !traceOn) {                       // drop any stale blocks
+    traceEnc[traceFront].finish();
+    traceReadyLen  = 0;
+    traceSerialOff = 0;
+  }
+  traceOn = on;
+}
+
+// Seal the front trace block into the back slot (no I/O; see serviceTrace()).
+// False if the back block hasn't been sent yet.
+bool sealTrace() {
+  if (traceReadyLen) return false;
+  size_t len = traceEnc[traceFront].finish();
+  if (!len) return true;
+  traceReadyLen  = len;
+  traceWsSent    = false;
+  traceSerialOff = 0;
+  traceFront    ^= 1u;
+  return true;
+}
+
+void traceSample(uint8_t ch, uint32_t ts_ms, uint16_t dist) {
+  if (traceEnc[traceFront].add(ch, ts_ms, dist)) return;
+  if (!sealTrace()) { traceDropped++; return; }
+  traceEnc[traceFront].add(ch, ts_ms, dist);
+}
+
+// Send the sealed trace block: one frame to each WS trace client, then down
+// Serial only as fast as its TX buffer takes it.  Runs from the idle point.
+void serviceTrace() {
+  if (!traceReadyLen) return;
+  const uint8_t* block = traceEnc[traceFront ^ 1u].data();
+  if (!traceWsSent) {
+    for (uint8_t i = 0; i < MAX_WS_CLIENTS; i++) {
+      if (wsClients[i].sock && wsClients[i].trace) {
+        wsSendBinary(*wsClients[i].sock, block, traceReadyLen);
+      }
+    }
+    traceWsSent = true;
+  }
+  if (traceSerial && traceSerialOff < traceReadyLen) {
+    int room = Serial.availableForWrite();
+    if (room <= 0) return;
+    size_t n = traceReadyLen - traceSerialOff;
+    if (n > (size_t)room) n = room;
+    Serial.write(block + traceSerialOff, n);
+    traceSerialOff += n;
+    if (traceSerialOff < traceReadyLen) return;
+  }
+  traceReadyLen  = 0;
+  traceSerialOff = 0;
+}
+
+#if FC_TELEMETRY
+// Queue one sample for the telemetry channel (O(1), no I/O).
+void telemetrySample(uint8_t ch, uint32_t ts_ms, uint16_t dist) {
+  uint8_t flags = (uint8_t)bank.state[ch] & 0x03u;
+  if (bank.sensorOk(ch))        flags |= FC_TELEMETRY_ONLINE;
+  if ((calibMask >> ch) & 1u)   flags |= FC_TELEMETRY_CALIBRATING;
+#if FC_SAMPLE_FILTER
+  uint8_t status = laneRangeStatus[ch];
+#else
+  uint8_t status = 0;
+#endif
+  telemetry.add(ch, ts_ms, dist, flags, status);
+}
+
+// Seal the batch when it is due and send the one waiting, if any.
+void serviceTelemetry(uint32_t now) {
+  if (!telemetryOwner) return;
+  telemetry.flushIfDue(now, TELEMETRY_PERIOD_MS);
+  size_t len;
+  const uint8_t* batch = telemetry.ready(len);
+  if (!batch) return;
+  telemetryUdp.beginPacket(telemetryDest, telemetryPort);
+  telemetryUdp.write(batch, len);
+  telemetryUdp.endPacket();
+  telemetry.release();
+}
+#endif
+
+// ── Command handlers ({"cmd":"…"} messages, see WS_COMMANDS) ─────────────
+
+// Sending side of a command; client is null if the table was full.
+struct WsCommandCtx {
+  net::WebSocket* sock;
+  WsClientSlot*   client;
+};
+
+// "lane": N → that lane's bit; missing or 0 → all lanes; out of range → 0.
+static uint32_t laneMaskArg(const JsonArgs& args) {
+  int32_t lane = args.intOr("lane", 0);
+  if (lane == 0) return ALL_LANES_MASK;
+  return (lane >= 1 && lane <= NUM_LANES) ? 1u << (lane - 1) : 0;
+}
+
+// {"cmd":"reset"} — all counts.  {"cmd":"reset","lane":N} — one lane.
+static void cmdReset(const JsonArgs& args, void*) {
+  uint32_t mask = laneMaskArg(args);
+  if (!mask) {
+    LOG_WARN("[WS] reset: no such lane");
+    return;
+  }
+  if (mask == ALL_LANES_MASK) {
+    bank.reset(totalCount);
+    countBins.begin(millis(), COUNT_BIN_MS);   // new match, new history
+    countLog.clear();                 // old events no longer apply
+  } else {
+    for (uint8_t ch = 0; ch < NUM_LANES; ch++) {
+      if (!((mask >> ch) & 1u)) continue;
+      totalCount   -= bank.count[ch];
+      bank.count[ch] = 0;
+      bank.state[ch] = LaneState::IDLE;
+    }
+    laneResetSeq = countLog.lastSeq() + 1;   // later resumes still apply
+  }
+  dirtyLanes   |= mask;
+  countsChanged = true;
+  LOG_INFO("[WS] Counts reset (lanes 0x%lx)", (unsigned long)mask);
+}
+
+// {"cmd":"proto","bin":1} — the snapshot (or resume reply) that follows
+// uses the new format.
+static void cmdProto(const JsonArgs& args, void* ctx) {
+  WsClientSlot* client = static_cast<WsCommandCtx*>(ctx)->client;
+  if (client) client->binary = args.intOr("bin", 0) != 0;
+}
+
+// {"cmd":"resume","seq":N} — only the count events after N.
+static void cmdResume(const JsonArgs& args, void* ctx) {
+  WsClientSlot* client = static_cast<WsCommandCtx*>(ctx)->client;
+  if (!client) return;
+  uint32_t seq;
+  if (args.getUint("seq", seq)) sendResume(*client, seq);
+  else                          sendSnapshot(*client);
+}
+
+// {"cmd":"snapshot"} — full resync (e.g. after a sequence gap).
+static void cmdSnapshot(const JsonArgs&, void* ctx) {
+  WsClientSlot* client = static_cast<WsCommandCtx*>(ctx)->client;
+  if (client) { client->snapshotPending = false; sendSnapshot(*client); }
+}
+
+// {"cmd":"profile","lane":N,"p":"fast"} — ranging preset (lane 0 = all).
+static void cmdProfile(const JsonArgs& args, void*) {
+  const char* name;
+  size_t      len;
+  RangingProfile profile;
+  if (!args.getString("p", name, len) || !parseRangingProfile(name, len, profile)) return;
+  uint32_t mask = laneMaskArg(args);
+  for (uint8_t ch = 0; ch < NUM_LANES; ch++) {
+    if (((mask >> ch) & 1u) && applyRangingProfile(ch, profile)) configDirty = true;
+  }
+}
+
+// {"cmd":"set"} reply: effective lockout per lane + mask of hand-set ones.
+static char setReplyBuf[48 + 11 * NUM_LANES];
+
+/**
+ * {"cmd":"set","lane":N,"delta":80,"hyst":30,"lockout":60,"dwell_pct":50}
+ * Any subset of keys: delta/hyst move the lane's thresholds around its
+ * live baseline, lockout pins the lane's dead time and takes it out of
+ * adaptive lockout (0 = adaptive again), dwell_pct sets the adaptive ratio
+ * for all lanes (0 = fixed lockout).  delta/hyst/lockout are saved.
+ * Replies {"cmd":"set","lockout":[ms,…],"fixed":mask} with the values now
+ * in force.
+ */
+static void cmdSet(const JsonArgs& args, void* ctx) {
+  uint32_t mask = laneMaskArg(args);
+  int32_t  v;
+  for (uint8_t ch = 0; ch < NUM_LANES; ch++) {
+    if (!((mask >> ch) & 1u)) continue;
+    int32_t delta = args.intOr("delta", bank.delta_mm[ch]);
+    int32_t hyst  = args.intOr("hyst",  bank.hyst_mm[ch]);
+    if (delta > 0 && delta < bank.baseline_mm[ch] && hyst >= 0 && hyst < delta &&
+        (delta != bank.delta_mm[ch] || hyst != bank.hyst_mm[ch])) {
+      bank.setDetection(ch, (uint16_t)delta, (uint16_t)hyst);
+      configDirty = true;
+    }
+    if (args.getInt("lockout", v) && v >= 0 && v <= 0xFFFF) {
+      bank.setFixedLockout(ch, (uint32_t)v);
+      configDirty = true;
+    }
+  }
+  if (args.getInt("dwell_pct", v) && v >= 0 && v <= 255) {
+    bank.setAdaptiveLockout((uint8_t)v, bank.lockoutMin_ms, bank.lockoutMax_ms);
+  }
+  LOG_INFO("[WS] Lane settings changed (lanes 0x%lx)", (unsigned long)mask);
+
+  JsonWriter j(setReplyBuf, sizeof(setReplyBuf));
+  j.beginObject().field("cmd", "set").beginArray("lockout");
+  for (uint8_t ch = 0; ch < NUM_LANES; ch++) j.value(bank.lockout_ms[ch]);
+  j.endArray().field("fixed", bank.fixedLockoutMask).endObject();
+  wsSendText(*static_cast<WsCommandCtx*>(ctx)->sock, j.c_str());
+}
+
+// {"cmd":"calibrate","lane":N} — background recalibration (0 = all).
+static void cmdCalibrate(const JsonArgs& args, void*) {
+  uint32_t mask = laneMaskArg(args);
+  if (mask) beginCalibration(mask);
+}
+
+// {"cmd":"trace","on":1} for this client, {"cmd":"trace","serial":1} for Serial.
+static void cmdTrace(const JsonArgs& args, void* ctx) {
+  WsClientSlot* client = static_cast<WsCommandCtx*>(ctx)->client;
+  int32_t serial;
+  if (args.getInt("serial", serial)) traceSerial   = serial != 0;
+  else if (client)                   client->trace = args.intOr("on", 0) != 0;
+  updateTraceOn();
+}
+
+// {"cmd":"rate","hz":2} — this client's update rate (0 = default, the max).
+static void cmdRate(const JsonArgs& args, void* ctx) {
+  WsClientSlot* client = static_cast<WsCommandCtx*>(ctx)->client;
+  uint32_t hz;
+  if (!client || !args.getUint("hz", hz)) return;
+  uint32_t ms = hz ? 1000u / hz : 0;
+  if (ms && ms < BROADCAST_MIN_INTERVAL_MS) ms = BROADCAST_MIN_INTERVAL_MS;
+  if (ms > BROADCAST_MAX_INTERVAL_MS)       ms = BROADCAST_MAX_INTERVAL_MS;
+  client->interval_ms = (uint16_t)ms;
+}
+
+#if FC_TELEMETRY
+// {"cmd":"telemetry","on":1,"port":N} — raw samples by UDP to the sender.
+static void cmdTelemetry(const JsonArgs& args, void* ctx) {
+  net::WebSocket* sock = static_cast<WsCommandCtx*>(ctx)->sock;
+  if (!args.intOr("on", 0)) {
+    if (telemetryOwner == sock) telemetryOwner = nullptr;
+    return;
+  }
+  int32_t port = args.intOr("port", TELEMETRY_UDP_PORT);
+  if (port < 1 || port > 65535) return;
+  if (!telemetryUdpOpen) telemetryUdpOpen = telemetryUdp.begin(TELEMETRY_UDP_PORT) != 0;
+  telemetry.clear();
+  telemetryDest  = sock->getRemoteIP();
+  telemetryPort  = (uint16_t)port;
+  telemetryOwner = sock;
+  LOG_INFO("[Tel] Streaming samples to UDP port %u", telemetryPort);
+}
+#endif
+
+// {"cmd":"ping"} — answered to the sender only.  An optional "t" (the
+// client's clock) is echoed back, so the client can time the round trip
+// and map our ts onto its own clock.
+static void cmdPing(const JsonArgs& args, void* ctx) {
+  char pong[48];                      // {"cmd":"pong","ts":4294967295,"t":4294967295}
+  JsonWriter j(pong, sizeof(pong));
+  uint32_t t;
+  j.beginObject().field("cmd", "pong").field("ts", (uint32_t)millis());
+  if (args.getUint("t", t)) j.field("t", t);
+  j.endObject();
+  wsSendText(*static_cast<WsCommandCtx*>(ctx)->sock, j.c_str());
+}
+
+// Add a row here to add a command.
+static const WsCommand WS_COMMANDS[] = {
+  { "reset",     cmdReset     },
+  { "proto",     cmdProto     },
+  { "resume",    cmdResume    },
+  { "snapshot",  cmdSnapshot  },
+  { "profile",   cmdProfile   },
+  { "set",       cmdSet       },
+  { "calibrate", cmdCalibrate },
+  { "trace",     cmdTrace     },
+  { "ping",      cmdPing      },
+  { "rate",      cmdRate      },
+#if FC_TELEMETRY
+  { "telemetry", cmdTelemetry },
+#endif
+};
+static const uint8_t WS_COMMAND_COUNT = sizeof(WS_COMMANDS) / sizeof(WS_COMMANDS[0]);
+WsCommandTable<32> wsCommands;        // keep ≤ ¾ full
+static_assert(WS_COMMAND_COUNT <= 24, "grow wsCommands");
+
+void onWsMessage(net::WebSocket& wsClient,
                  const net::WebSocket::DataType /* dt */,
                  const char* message,
                  uint16_t length)
 {
-  // Minimal JSON parsing (avoid heavy libraries on constrained MCU)
-  String msg(message);
-  msg.trim();
-  Serial.print(F("[WS] Rx: ")); Serial.println(msg);
-
-  if (msg.indexOf("\"reset\"") >= 0) {
-    // ── Reset all counts ────────────────────────────────────────────
-    resetLanes(lanes, NUM_LANES, totalCount);
-    countsChanged = true;
-    Serial.println(F("[WS] Counts reset"));
-  }
-  else if (msg.indexOf("\"ping\"") >= 0) {
-    // ── Ping / pong ─────────────────────────────────────────────────
-    if (ws) {
-      String pong = "{\"cmd\":\"pong\",\"ts\":" + String(millis()) + "}";
-      ws->broadcastTXT(pong);
-    }
+  // Parsed in place — no copy, no heap
+  LOG_DEBUG("[WS] Rx: %.*s", (int)length, message);
+  WsCommandCtx ctx = { &wsClient, findWsClient(wsClient) };
+  if (wsCommands.dispatch(message, length, &ctx) != WsCommandTable<32>::OK) {
+    LOG_WARN("[WS] Unknown command: %.*s", (int)(length < 48 ? length : 48), message);
   }
 }
 
-void onWsClose(net::WebSocket& /* wsClient */,
+void onWsClose(net::WebSocket& wsClient,
                const net::WebSocket::CloseCode /* code */,
                const char* /* reason */,
                uint16_t /* length */)
 {
-  Serial.println(F("[WS] Client disconnected"));
+  WsClientSlot* slot = findWsClient(wsClient);
+  if (slot) *slot = WsClientSlot();
+  updateTraceOn();
+#if FC_TELEMETRY
+  if (telemetryOwner == &wsClient) telemetryOwner = nullptr;
+#endif
+  LOG_INFO("[WS] Client disconnected");
+}
+
+// ═══════════════════════════════════════════════════════════════════════════
+//  MULTI-HUB LINK  (FC_HUB_ROLE)
+// ═══════════════════════════════════════════════════════════════════════════
+
+#if FC_HUB_ROLE == FC_HUB_REPORTER
+// Report this hub's counts to the aggregator (the AP we joined).
+static void sendHubReport(uint32_t now) {
+  HubCounts hdr;
+  hdr.hubId  = FC_HUB_ID;
+  hdr.nLanes = NUM_LANES;
+  hdr.seq    = ++hubSeq;
+  hdr.ts_ms  = now;
+  hdr.total  = totalCount;
+  hdr.okMask = bank.okMask;
+  hdr.bootId = hubBootId;
+  size_t len = encodeHubCounts(hubBuf, sizeof(hubBuf), hdr, bank.count);
+  if (!len) return;
+  hubUdp.beginPacket(WiFi.gatewayIP(), HUB_UDP_PORT);
+  hubUdp.write(hubBuf, len);
+  hubUdp.endPacket();
+  hubLocalChanged = false;
+  lastHubTxMs     = now;
+}
+
+// Station join; blocking for as long as the Wi-Fi module takes.
+static bool joinAggregator() {
+  hubLinkUp       = WiFi.begin(AP_SSID, AP_PASSWORD) == WL_CONNECTED;
+  lastJoinMs      = millis();
+  lastLinkCheckMs = lastJoinMs;
+  return hubLinkUp;
+}
+
+// True when a blocking rejoin would cost no counts: every lane idle and
+// calibrated, and no ball counted for HUB_REJOIN_QUIET_MS.
+static bool lanesQuiet(uint32_t now) {
+  if (calibMask || (boot.firstBallMs && (int32_t)(now - lastCountMs) < (int32_t)HUB_REJOIN_QUIET_MS)) return false;
+  for (uint8_t ch = 0; ch < NUM_LANES; ch++) {
+    if (bank.sensorOk(ch) && bank.state[ch] != LaneState::IDLE) return false;
+  }
+  return true;
+}
+#endif
+
+#if FC_HUB_ROLE == FC_HUB_AGGREGATOR
+// Drain a few pending hub datagrams into the table.
+static void receiveHubReports(uint32_t now) {
+  static uint32_t counts[FC_HUB_MAX_LANES];
+  for (uint8_t n = 0; n < HUB_RX_PER_LOOP; n++) {
+    int size = hubUdp.parsePacket();
+    if (size <= 0) break;
+    int len = hubUdp.read(hubBuf, sizeof(hubBuf));
+    HubCounts hdr;
+    if (len <= 0 || !decodeHubCounts(hubBuf, (size_t)len, hdr, counts)) continue;
+    if (hdr.hubId == FC_HUB_ID) continue;       // misconfigured twin of this hub
+    if (hubTable.accept(hdr, counts, now) == HubTable::CHANGED) hubsChanged = true;
+  }
+  uint8_t online = hubTable.onlineMask(now, HUB_STALE_MS);
+  if (online != hubsOnline) { hubsOnline = online; hubsChanged = true; }
+}
+
+// Push the combined scoreboard to every client.
+static void broadcastHubs(uint32_t now) {
+  const char* json = buildHubsJson();
+  for (uint8_t i = 0; i < MAX_WS_CLIENTS; i++) {
+    if (wsClients[i].sock) wsSendText(*wsClients[i].sock, json);
+  }
+  hubsChanged    = false;
+  lastHubsSendMs = now;
+}
+#endif
+
+// One pass of the hub link from loop().
+void serviceHubLink(uint32_t now) {
+#if FC_HUB_ROLE == FC_HUB_REPORTER
+  if (now - lastLinkCheckMs >= HUB_LINK_CHECK_MS) {
+    lastLinkCheckMs = now;
+    bool up = WiFi.status() == WL_CONNECTED;
+    if (!up && hubLinkUp) LOG_WARN("[Hub] Lost the aggregator AP");
+    hubLinkUp = up;
+  }
+  if (!hubLinkUp) {
+    if (now - lastJoinMs < rejoinGapMs || !lanesQuiet(now)) return;
+    LOG_INFO("[Hub] Rejoining the aggregator AP");
+    if (joinAggregator()) {
+      rejoinGapMs = HUB_RECONNECT_MS;
+      LOG_INFO("[Hub] Rejoined");
+    } else {
+      rejoinGapMs = rejoinGapMs * 2 < HUB_RECONNECT_MAX_MS ? rejoinGapMs * 2 : HUB_RECONNECT_MAX_MS;
+    }
+    return;
+  }
+  if (hubLocalChanged || now - lastHubTxMs >= HUB_HEARTBEAT_MS) sendHubReport(now);
+#elif FC_HUB_ROLE == FC_HUB_AGGREGATOR
+  receiveHubReports(now);
+  if (hubLocalChanged) { hubLocalChanged = false; hubsChanged = true; }
+  if (hubsChanged && now - lastHubsSendMs >= HUB_BROADCAST_MIN_MS &&
+      ws && ws->connectedClients() > 0) {
+    broadcastHubs(now);
+  }
+#else
+  (void)now;
+#endif
 }
 
 // ═══════════════════════════════════════════════════════════════════════════
 //  SENSOR INITIALISATION & CALIBRATION
 // ═══════════════════════════════════════════════════════════════════════════
 
+#if FC_SAMPLE_FILTER
+// Sample-filter signal floor for a profile, MCPS 9.7 fixed point.
+static uint16_t signalFloorQ7(RangingProfile profile) {
+  return (uint16_t)(rangingParams(profile).signalRateLimit_mcps * 128.0f *
+                    FILTER_SIGNAL_FLOOR_PCT / 100.0f);
+}
+#endif
+
+// Program a ranging preset.  The sensor must not be in continuous mode.
+bool configureRanging(uint8_t ch, RangingProfile profile) {
+  const RangingParams& rp = rangingParams(profile);
+  bool ok = tof[ch].setSignalRateLimit(rp.signalRateLimit_mcps);
+  ok &= tof[ch].setVcselPulsePeriod(VL53L0X::VcselPeriodPreRange,   rp.preRangeVcsel_pclks);
+  ok &= tof[ch].setVcselPulsePeriod(VL53L0X::VcselPeriodFinalRange, rp.finalRangeVcsel_pclks);
+  ok &= tof[ch].setMeasurementTimingBudget(rp.timingBudget_us);
+  return ok;
+}
+
+// Switch a running lane to another preset without a reboot.  Counting
+// state and thresholds are kept; the lane just misses one sample.
+bool applyRangingProfile(uint8_t ch, RangingProfile profile) {
+  if (!bank.sensorOk(ch)) return false;
+  muxSelect(ch);
+  tof[ch].stopContinuous();
+  bool ok = configureRanging(ch, profile);
+  tof[ch].startContinuous(0);
+  if (ok) laneProfile[ch] = profile;
+#if FC_SAMPLE_FILTER
+  if (ok) sampleFilter.setMinSignal(ch, signalFloorQ7(profile));
+#endif
+
+  if (ok) LOG_INFO("[ToF] Lane %u  profile = %s", ch + 1, rangingParams(profile).name);
+  else    LOG_ERROR("[ToF] Lane %u  profile = %s  (FAILED)", ch + 1, rangingParams(profile).name);
+  return ok;
+}
+
+// ── Bring-up steps, shared by boot and hot recovery ─────────────────────
+
+#if FC_USE_XSHUT
+// Hold the sensor in reset (also keeps a dead one off 0x29).
+void laneSensorPowerDown(uint8_t ch) {
+  pinMode(LANE_XSHUT_PINS[ch], OUTPUT);
+  digitalWrite(LANE_XSHUT_PINS[ch], LOW);
+}
+
+// Release reset; the sensor comes back at its 0x29 power-on address.
+void laneSensorPowerUp(uint8_t ch) {
+  pinMode(LANE_XSHUT_PINS[ch], INPUT);    // breakout pull-up releases reset
+  tof[ch] = VL53L0X();
+}
+#endif
+
+// Library init, then (XSHUT) move the sensor to its lane address before
+// any other sensor is released.
+bool laneSensorInit(uint8_t ch) {
+#if !FC_USE_XSHUT
+  muxSelect(ch);
+#endif
+  tof[ch].setTimeout(SENSOR_TIMEOUT_MS);
+  if (!tof[ch].init()) {
+#if FC_USE_XSHUT
+    laneSensorPowerDown(ch);
+#endif
+    return false;
+  }
+#if FC_USE_XSHUT
+  tof[ch].setAddress(TOF_ADDR_BASE + ch);
+#endif
+  return true;
+}
+
+// Use continuous mode for best throughput (~33 ms/reading at default budget)
+void laneSensorStart(uint8_t ch) {
+  muxSelect(ch);
+  tof[ch].startContinuous(0);         // 0 = back-to-back, no inter-measurement gap
+}
+
+// Bring up a single lane's sensor and start it ranging (blocking; boot).
+bool initLaneSensor(uint8_t ch) {
+#if FC_USE_XSHUT
+  // Pulse XSHUT so the sensor comes back at its power-on address
+  laneSensorPowerDown(ch);
+  delay(2);
+  laneSensorPowerUp(ch);
+#endif
+  delay(10);
+  if (!laneSensorInit(ch)) return false;
+  configureRanging(ch, laneProfile[ch]);
+  laneSensorStart(ch);
+  return true;
+}
+
+// Assign every lane to a mux/channel: the stored map on a warm start,
+// else the default one.
+void initLaneWiring() {
+  muxCount = 0;
+  for (uint8_t ch = 0; ch < NUM_LANES; ch++) {
+    laneWiring[ch] = warmStart ? storedConfig.lane[ch].wiring : defaultLaneWiring(ch);
+    if (laneWiring[ch].mux + 1 > muxCount) muxCount = laneWiring[ch].mux + 1;
+  }
+}
+
 void initSensors() {
   Wire.begin();
   Wire.setClock(400000);              // 400 kHz fast-mode I2C
+  initLaneWiring();
 
   for (uint8_t ch = 0; ch < NUM_LANES; ch++) {
-    muxSelect(ch);
-    delay(10);
+    laneProfile[ch] = warmStart ? (RangingProfile)storedConfig.lane[ch].profile
+                                : FC_DEFAULT_PROFILE;
+  }
+  bank.setLockout(LOCKOUT_MS);
+  bank.setAdaptiveLockout(LOCKOUT_DWELL_PCT, LOCKOUT_MIN_MS, LOCKOUT_MAX_MS);
+  bank.setMultiBall(MAX_BALLS_PER_PASS, MULTI_BALL_DIP_MM);
+  bank.setDriftTracking(BASELINE_DRIFT_SHIFT, BASELINE_DRIFT_STEP_Q8,
+                        BASELINE_DRIFT_WINDOW_MM, BASELINE_DRIFT_LIMIT_MM);
+#if FC_SAMPLE_FILTER
+  sampleFilter.configure(FILTER_MEDIAN, true, 0);
+  for (uint8_t ch = 0; ch < NUM_LANES; ch++) sampleFilter.setMinSignal(ch, signalFloorQ7(laneProfile[ch]));
+#endif
 
-    tof[ch].setTimeout(SENSOR_TIMEOUT_MS);
+#if FC_USE_XSHUT
+  // Hold every sensor in reset; initLaneSensor() releases them one by one
+  static_assert(sizeof(LANE_XSHUT_PINS) >= NUM_LANES, "LANE_XSHUT_PINS needs an entry per lane");
+  for (uint8_t ch = 0; ch < NUM_LANES; ch++) {
+    pinMode(LANE_XSHUT_PINS[ch], OUTPUT);
+    digitalWrite(LANE_XSHUT_PINS[ch], LOW);
+  }
+  delay(10);
+#endif
 
-    if (!tof[ch].init()) {
-      Serial.print(F("[ToF] Lane "));
-      Serial.print(ch + 1);
-      Serial.println(F("  INIT FAILED  — check wiring!"));
-      lanes[ch].sensorOk = false;
-      continue;
-    }
+  for (uint8_t ch = 0; ch < NUM_LANES; ch++) {
+    bool ok = initLaneSensor(ch);
+    bank.setSensorOk(ch, ok);
+    laneHealth[ch].begin(&LANE_HEALTH_CFG, ok, millis());
+    lastSampleMs[ch] = millis();
+    if (ok) LOG_INFO("[ToF] Lane %u  OK", ch + 1);
+    else    LOG_ERROR("[ToF] Lane %u  INIT FAILED  — check wiring! (will retry)", ch + 1);
+  }
+}
 
-    // Use continuous mode for best throughput (~33 ms/reading at default budget)
-    tof[ch].startContinuous(0);       // 0 = back-to-back, no inter-measurement gap
-    lanes[ch].sensorOk = true;
+// ── Stored configuration (EEPROM) ───────────────────────────────────────
 
-    Serial.print(F("[ToF] Lane "));
-    Serial.print(ch + 1);
-    Serial.println(F("  OK"));
+// Read the image; true if it is valid for this build's lanes, muxes and
+// wiring mode.  Anything else cold-calibrates.
+bool loadConfig() {
+  EEPROM.get(CONFIG_EEPROM_ADDR, storedConfig);
+  return configValid(storedConfig, CONFIG_WIRING, laneMuxCount(NUM_LANES));
+}
+
+// Snapshot the live calibration into the image and write it (only bytes
+// that changed are rewritten).
+void saveConfig() {
+  memset(&storedConfig, 0, sizeof(storedConfig));
+  for (uint8_t ch = 0; ch < NUM_LANES; ch++) {
+    StoredLane& l = storedConfig.lane[ch];
+    l.baseline_mm = bank.calBaseline_mm[ch];
+    l.delta_mm    = bank.delta_mm[ch];
+    l.hyst_mm     = bank.hyst_mm[ch];
+    l.profile     = (uint8_t)laneProfile[ch];
+    l.wiring      = laneWiring[ch];
+    l.lockout_ms  = bank.lockoutFixed(ch) ? (uint16_t)bank.lockout_ms[ch] : 0;
+    l.calibrated  = bank.calBaseline_mm[ch] != 0;   // 0: never had a baseline
   }
+  sealConfig(storedConfig, CONFIG_WIRING);
+  EEPROM.put(CONFIG_EEPROM_ADDR, storedConfig);
+  configDirty = false;
+  LOG_INFO("[Cfg] Calibration saved");
 }
 
-void calibrateBaselines() {
-  Serial.println(F("[Cal] Calibrating baselines — keep lanes CLEAR …"));
-  delay(500);
+// Warm start: take thresholds from the image and arm the per-lane check.
+// Lanes the image has no baseline for are calibrated from scratch.
+void applyStoredCalibration() {
+  warmCheckMask = 0;
+  const uint32_t cold = uncalibratedLanes(storedConfig);
+  for (uint8_t ch = 0; ch < NUM_LANES; ch++) {
+    const StoredLane& l = storedConfig.lane[ch];
+    bank.setFixedLockout(ch, l.lockout_ms);
+    if ((cold >> ch) & 1u) continue;
+    bank.calculateThresholds(ch, l.baseline_mm, l.delta_mm, l.hyst_mm);
+    if (!bank.sensorOk(ch)) continue;
+    warmCheck[ch].begin(l.baseline_mm, WARM_CHECK_SAMPLES,
+                        WARM_CHECK_TOLERANCE_MM, WARM_CHECK_SPREAD_MM);
+    warmCheckMask |= 1u << ch;
+
+    LOG_INFO("[Cfg] Lane %u  stored baseline = %u mm", ch + 1, l.baseline_mm);
+  }
+  beginCalibration(cold);
+}
 
+// Feed one live reading to a lane's warm-start check; starts a background
+// recalibration of the lane if the stored baseline no longer fits.
+void checkWarmBaseline(uint8_t ch, uint16_t dist) {
+  BaselineCheck::Result r = warmCheck[ch].add(dist);
+  if (r == BaselineCheck::PENDING) return;
+  warmCheckMask &= ~(1u << ch);
+  if (r == BaselineCheck::MATCH) return;
+
+  LOG_WARN("[Cfg] Lane %u  reads %u mm, not the stored baseline — recalibrating",
+           ch + 1, warmCheck[ch].mean());
+  beginCalibration(1u << ch);
+}
+
+// Start (re)calibrating the lanes in mask.  Runs from loop(): samples
+// from those lanes go to their calibrators instead of the counter.
+void beginCalibration(uint32_t mask) {
+  mask &= bank.okMask;
+  const uint32_t now = millis();
+  if (mask && !calibMask) calibStartMs = now;
   for (uint8_t ch = 0; ch < NUM_LANES; ch++) {
-    if (!lanes[ch].sensorOk) continue;
+    if (!((mask >> ch) & 1u)) continue;
+    calib[ch].begin();
+    calibTries[ch]       = 0;
+    calibLaneStartMs[ch] = now;       // lanes already calibrating keep theirs
+#if FC_SAMPLE_FILTER
+    sampleFilter.resetLane(ch);       // stale history from before
+#endif
+  }
+  warmCheckMask &= ~mask;
+  calibMask     |= mask;
+  if (mask) LOG_INFO("[Cal] Calibrating baselines — keep lanes CLEAR …");
+}
 
-    uint32_t sum = 0;
-    uint8_t  good = 0;
+// Settle a lane whose calibration window just filled.
+static void finishLaneCalibration(uint8_t ch) {
+  uint16_t baseline, mad;
+  uint8_t  inliers;
+  bool ok = calib[ch].result(baseline, mad, inliers) && mad <= CALIB_MAX_MAD_MM;
+  if (!ok && ++calibTries[ch] < CALIB_MAX_TRIES) {
+    calib[ch].begin();                // too noisy — take another window
+    return;
+  }
+  calibMask &= ~(1u << ch);
+  if (!ok) {
+    bank.setSensorOk(ch, false);
+    laneHealth[ch].markOffline(millis());
+    LOG_ERROR("[Cal] Lane %u  calibration FAILED", ch + 1);
+    return;
+  }
 
-    muxSelect(ch);
-    delay(5);
+  // Keep any per-lane delta / hysteresis already set (from EEPROM)
+  uint16_t delta = bank.delta_mm[ch] ? bank.delta_mm[ch] : DETECTION_DELTA_MM;
+  uint16_t hyst  = bank.hyst_mm[ch]  ? bank.hyst_mm[ch]  : CLEAR_HYSTERESIS_MM;
+  bank.calculateThresholds(ch, baseline, delta, hyst);
+  bank.state[ch] = LaneState::IDLE;
+  configDirty    = true;
 
-    for (uint8_t s = 0; s < CALIB_SAMPLES; s++) {
-      uint16_t d = tof[ch].readRangeContinuousMillimeters();
-      if (!tof[ch].timeoutOccurred() && d < 8000) {
-        sum += d;
-        good++;
-      }
-      delay(35);
-    }
+  LOG_INFO("[Cal] Lane %u  baseline = %u mm  threshold = %u mm  MAD = %u  inliers = %u",
+           ch + 1, bank.baseline_mm[ch], bank.threshold_mm[ch], mad, inliers);
+}
 
-    if (good > 0) {
-      calculateThresholds(lanes[ch], sum / good, DETECTION_DELTA_MM, CLEAR_HYSTERESIS_MM);
+// Route one sample of a calibrating lane to its calibrator.
+void feedCalibration(uint8_t ch, uint16_t dist) {
+  if (calib[ch].add(dist)) finishLaneCalibration(ch);
+}
 
-      Serial.print(F("[Cal] Lane "));
-      Serial.print(ch + 1);
-      Serial.print(F("  baseline = "));
-      Serial.print(lanes[ch].baseline_mm);
-      Serial.print(F(" mm  threshold = "));
-      Serial.print(lanes[ch].threshold_mm);
-      Serial.println(F(" mm"));
-    } else {
-      lanes[ch].sensorOk = false;
-      Serial.print(F("[Cal] Lane "));
-      Serial.print(ch + 1);
-      Serial.println(F("  calibration FAILED"));
-    }
+// Give up on lanes that stopped delivering samples, each timed from when
+// its own calibration began.
+void serviceCalibration() {
+  if (!calibMask) return;
+  const uint32_t now = millis();
+  for (uint8_t ch = 0; ch < NUM_LANES; ch++) {
+    if (!((calibMask >> ch) & 1u)) continue;
+    if (now - calibLaneStartMs[ch] < CALIB_TIMEOUT_MS) continue;
+    calibTries[ch] = CALIB_MAX_TRIES;  // no retry after a timeout
+    finishLaneCalibration(ch);         // clears the lane's calibMask bit
   }
-  Serial.println(F("[Cal] Done."));
 }
 
 // ═══════════════════════════════════════════════════════════════════════════
-//  LANE STATE-MACHINE UPDATE  (called every loop iteration)
+//  READINESS-DRIVEN SAMPLING
 // ═══════════════════════════════════════════════════════════════════════════
+//
+//  readRangeContinuousMillimeters() spins on RESULT_INTERRUPT_STATUS until
+//  a sample is available, so calling it on each lane in turn serialises all
+//  four conversions.  Instead we peek at the status register (one short
+//  read) and only fetch + clear the result when the sensor has one ready.
+//  Every sensor keeps converting back-to-back on its own, so each lane runs
+//  at the sensor's native rate (~30 Hz) regardless of the others.
 
-void updateLane(uint8_t ch) {
-  if (!lanes[ch].sensorOk) return;
-
+// True when the lane's sensor has a completed measurement waiting.
+bool laneSampleReady(uint8_t ch) {
   muxSelect(ch);
-  // Tiny delay for mux settling is not needed at 400 kHz in practice,
-  // but add 10 µs if you see glitches:
-  // delayMicroseconds(10);
+  i2cTransactions += 2;               // register-address write + 1-byte read
+  return (tof[ch].readReg(VL53L0X::RESULT_INTERRUPT_STATUS) & 0x07) != 0;
+}
 
-  uint16_t dist = tof[ch].readRangeContinuousMillimeters();
+// Fetch the pending range result and re-arm the data-ready flag.
+// Only call after laneSampleReady() returned true (mux already selected).
+uint16_t readLaneSample(uint8_t ch) {
+  i2cTransactions += 3;               // result read + interrupt clear
+#if FC_SAMPLE_FILTER
+  // One burst over the result block: status @0, signal rate @6, range @10
+  uint8_t r[12];
+  tof[ch].readMulti(VL53L0X::RESULT_RANGE_STATUS, r, sizeof(r));
+  laneRangeStatus[ch] = r[0];
+  laneSignal[ch]      = (uint16_t)((r[6] << 8) | r[7]);
+  uint16_t dist       = (uint16_t)((r[10] << 8) | r[11]);
+#else
+  uint16_t dist = tof[ch].readReg16Bit(VL53L0X::RESULT_RANGE_STATUS + 10);
+#endif
+  tof[ch].writeReg(VL53L0X::SYSTEM_INTERRUPT_CLEAR, 0x01);
+  return dist;
+}
 
-  if (tof[ch].timeoutOccurred()) {
-    // Sensor read error — skip this cycle
-    return;
+// Drop invalid readings from a batch and median-filter the rest.
+// @return the lanes left to count
+uint32_t filterBatch(uint16_t* dist, uint32_t fresh) {
+#if FC_SAMPLE_FILTER
+  return sampleFilter.filterReadings(dist, laneRangeStatus, laneSignal, fresh);
+#else
+  (void)dist;
+  return fresh;
+#endif
+}
+
+// ═══════════════════════════════════════════════════════════════════════════
+//  DATA-READY INTERRUPTS  (optional, FC_USE_LANE_IRQ)
+// ═══════════════════════════════════════════════════════════════════════════
+
+// The ISR only stamps and flags its lane; all I2C work stays in loop().
+template <uint8_t CH>
+void laneReadyIsr() {
+  laneReadyMs[CH] = millis();
+  laneReadyMask.fetch_or(1u << CH, std::memory_order_release);
+}
+
+static void (*const LANE_ISRS[])() = {
+  laneReadyIsr<0>,  laneReadyIsr<1>,  laneReadyIsr<2>,  laneReadyIsr<3>,
+  laneReadyIsr<4>,  laneReadyIsr<5>,  laneReadyIsr<6>,  laneReadyIsr<7>,
+};
+static_assert(sizeof(LANE_IRQ_PINS) <= sizeof(LANE_ISRS) / sizeof(LANE_ISRS[0]),
+              "add laneReadyIsr<> entries for every LANE_IRQ_PINS slot");
+static_assert(!FC_USE_LANE_IRQ ||
+              (sizeof(LANE_IRQ_PINS) >= NUM_LANES &&
+               sizeof(LANE_ISRS) / sizeof(LANE_ISRS[0]) >= NUM_LANES),
+              "LANE_IRQ_PINS / LANE_ISRS need an entry per lane");
+
+// True when this lane is serviced from its GPIO1 interrupt.
+bool laneUsesIrq(uint8_t ch) {
+  return FC_USE_LANE_IRQ && ch < sizeof(LANE_IRQ_PINS) && LANE_IRQ_PINS[ch] != LANE_IRQ_NONE;
+}
+
+void attachLaneInterrupts() {
+  for (uint8_t ch = 0; ch < NUM_LANES; ch++) {
+    if (!laneUsesIrq(ch)) continue;     // offline lanes too: they may recover
+    pinMode(LANE_IRQ_PINS[ch], INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(LANE_IRQ_PINS[ch]), LANE_ISRS[ch], FALLING);
   }
+}
+
+// ═══════════════════════════════════════════════════════════════════════════
+//  LANE STATE-MACHINE UPDATE
+// ═══════════════════════════════════════════════════════════════════════════
 
-  // Delegate to the pure-logic state machine from fuel_counter lib
-  bool counted = processLaneReading(lanes[ch], dist, millis(), LOCKOUT_MS);
-  if (counted) {
-    totalCount++;
+// Book-keeping for every lane bit set in a processReadings() result.
+// Counts are stamped with the lane's capture time.
+void recordCounts(uint32_t countedMask) {
+  if (!boot.countingMs) boot.countingMs = millis();   // first counter pass
+  for (uint8_t ch = 0; countedMask; ch++, countedMask >>= 1) {
+    if (!(countedMask & 1u)) continue;
+    uint32_t now   = lastSampleMs[ch];
+    uint8_t  balls = bank.lastBalls[ch];
+    totalCount += balls;
+    if (!boot.firstBallMs) boot.firstBallMs = now;
+    lastCountMs = now;
+    if (!countPending || (int32_t)(now - pendingCountMs) < 0) {
+      pendingCountMs = now;
+      countPending   = true;
+    }
+    for (uint8_t b = 0; b < balls; b++) countLog.append(ch, now);
+    countBins.add(ch, now, balls);
+#if FC_METRICS
+    if (!metrics.unsent) { metrics.oldestUnsentUs = micros(); metrics.unsent = true; }
+#endif
+    dirtyLanes   |= 1u << ch;
     countsChanged = true;
-    Serial.print(F("[+] Lane "));
-    Serial.print(ch + 1);
-    Serial.print(F("  count="));
-    Serial.print(lanes[ch].count);
-    Serial.print(F("  total="));
-    Serial.println(totalCount);
+    if (balls > 1) {
+      LOG_INFO("[+] Lane %u  count=%lu  total=%lu  (x%u conf=%u%%)", ch + 1,
+               (unsigned long)bank.count[ch], (unsigned long)totalCount,
+               balls, bank.lastConfidence[ch]);
+    } else {
+      LOG_INFO("[+] Lane %u  count=%lu  total=%lu", ch + 1,
+               (unsigned long)bank.count[ch], (unsigned long)totalCount);
+    }
+  }
+}
+
+// Note that a lane delivered a sample captured at ts_ms (timeout tracking,
+// interval metric, trace capture).
+void noteLaneSample(uint8_t ch, uint16_t dist, uint32_t ts_ms) {
+  lastSampleMs[ch] = ts_ms;
+  laneHealth[ch].onSample();
+  if (traceOn) traceSample(ch, lastSampleMs[ch], dist);
+#if FC_TELEMETRY
+  if (telemetryOwner) telemetrySample(ch, lastSampleMs[ch], dist);
+#endif
+  if (warmCheckMask & (1u << ch)) checkWarmBaseline(ch, dist);
+  if (calibMask & (1u << ch))     feedCalibration(ch, dist);
+#if FC_METRICS
+  uint32_t us = micros();
+  if (metrics.lastSampleUs[ch]) metrics.laneInterval[ch].record(us - metrics.lastSampleUs[ch]);
+  metrics.lastSampleUs[ch] = us;
+#endif
+}
+
+// Expected gap between a lane's samples (its profile's timing budget).
+static uint32_t lanePeriodMs(uint8_t ch) {
+  return rangingParams(laneProfile[ch]).timingBudget_us / 1000u;
+}
+
+// Longest a healthy lane should go between samples.
+static uint32_t laneDeadlineMs(uint8_t ch) {
+  return lanePeriodMs(ch) + SENSOR_TIMEOUT_MS;
+}
+
+// Drop a lane from counting and tell clients its sN flag changed.
+static void takeLaneOffline(uint8_t ch) {
+  uint32_t bit = 1u << ch;
+  bank.setSensorOk(ch, false);
+  calibMask     &= ~bit;
+  warmCheckMask &= ~bit;
+  dirtyLanes    |= bit;
+  countsChanged  = true;
+}
+
+// Count one timeout per SENSOR_TIMEOUT_MS a live lane stays past its
+// deadline; enough in a row take it offline for recovery.
+void checkLaneTimeouts(uint32_t now) {
+  for (uint8_t ch = 0; ch < NUM_LANES; ch++) {
+    if (!bank.sensorOk(ch)) continue;
+    if (now - lastSampleMs[ch] <= laneDeadlineMs(ch)) continue;
+    if (now - lastTimeoutMs[ch] < SENSOR_TIMEOUT_MS) continue;
+    laneTimeouts[ch]++;
+    lastTimeoutMs[ch] = now;
+
+    LaneHealth before = laneHealth[ch].health();
+    LaneHealth after  = laneHealth[ch].onTimeout(now);
+    if (after == before) continue;
+    if (after == LaneHealth::OFFLINE) {
+      takeLaneOffline(ch);
+      LOG_ERROR("[ToF] Lane %u  no data for %lu ms — OFFLINE, recovering", ch + 1,
+                (unsigned long)(now - lastSampleMs[ch]));
+    } else {
+      LOG_WARN("[ToF] Lane %u  degraded (missed samples)", ch + 1);
+    }
   }
 }
 
+// Run one due recovery step for one lane (round-robin), so a dead sensor
+// never costs loop() more than a single bring-up stage per pass.
+void serviceLaneHealth(uint32_t now) {
+  for (uint8_t n = 0; n < NUM_LANES; n++) {
+    uint8_t ch = recoveryCursor;
+    recoveryCursor = (uint8_t)((recoveryCursor + 1) % NUM_LANES);
+    RecoveryStep step = laneHealth[ch].due(now);
+    if (step == RecoveryStep::NONE) continue;
+
+    uint32_t bit = 1u << ch;
+    bool ok = true;
+    switch (step) {
+#if FC_USE_XSHUT
+      case RecoveryStep::POWER_DOWN: laneSensorPowerDown(ch); break;
+      case RecoveryStep::POWER_UP:   laneSensorPowerUp(ch);   break;
+#endif
+      case RecoveryStep::INIT:       ok = laneSensorInit(ch); break;
+      case RecoveryStep::CONFIGURE:
+        muxSelect(ch);                  // polling may have moved the mux
+        ok = configureRanging(ch, laneProfile[ch]);
+        break;
+      case RecoveryStep::START:      laneSensorStart(ch);     break;
+      case RecoveryStep::CALIBRATE:
+        // Back online for sampling; samples go to the calibrator first
+        bank.setSensorOk(ch, true);
+        lastSampleMs[ch] = now;
+        beginCalibration(bit);
+        break;
+      case RecoveryStep::WAIT_CALIBRATION:
+        if (calibMask & bit) continue;  // still sampling
+        ok = bank.sensorOk(ch);         // finishLaneCalibration() decided
+        break;
+      default: break;
+    }
+    if (!ok) bank.setSensorOk(ch, false);
+    laneHealth[ch].stepDone(ok, now);
+
+    if (!ok) {
+      LOG_WARN("[ToF] Lane %u  recovery failed — retrying later", ch + 1);
+    } else if (laneHealth[ch].health() == LaneHealth::OK) {
+      dirtyLanes   |= bit;
+      countsChanged = true;
+      LOG_INFO("[ToF] Lane %u  recovered", ch + 1);
+    }
+    return;
+  }
+}
+
+// Polled path: fetch the lane's sample only if its sensor has one waiting.
+// @return true if dist was filled with a fresh reading
+bool updateLane(uint8_t ch, uint16_t& dist) {
+  if (!bank.sensorOk(ch)) return false;
+
+  // Tiny delay for mux settling is not needed at 400 kHz in practice,
+  // but add 10 µs after muxSelect() if you see glitches.
+  if (!laneSampleReady(ch)) {
+    // Conversion still in progress — move on to the next lane
+    return false;
+  }
+
+  dist = readLaneSample(ch);
+  noteLaneSample(ch, dist, millis());
+  return true;
+}
+
+// Interrupt path.  A flagged edge is not proof of a waiting sample: the
+// loop()'s fallback poll may already have read and cleared it, and reading
+// again would feed the old range to the counter a second time.  So the
+// status register is still checked before the result is fetched.
+void serviceLaneEvents() {
+  uint16_t dist[NUM_LANES];
+  uint32_t fresh = 0;
+  uint32_t ready = laneReadyMask.exchange(0, std::memory_order_acquire);
+  for (uint8_t ch = 0; ready; ch++, ready >>= 1) {
+    if (!(ready & 1u)) continue;
+    if (!bank.sensorOk(ch) || !laneSampleReady(ch)) continue;   // selects the mux
+    dist[ch] = readLaneSample(ch);
+    noteLaneSample(ch, dist[ch], laneReadyMs[ch]);   // stamped at the edge
+    fresh |= 1u << ch;
+  }
+  fresh = filterBatch(dist, fresh & ~calibMask);
+  if (fresh) recordCounts(bank.processReadings(dist, lastSampleMs, fresh));
+}
+
 // ═══════════════════════════════════════════════════════════════════════════
-//  SETUP
+//  SAMPLE DEADLINES  (optional hardware tick, FC_USE_SAMPLE_TIMER)
 // ═══════════════════════════════════════════════════════════════════════════
 
-void setup() {
-  Serial.begin(115200);
-  delay(1500);   // give Serial monitor time to attach
-  Serial.println(F("\n════════════════════════════════════════"));
-  Serial.println(F("  Hub Fuel Counter — UNO R4 WiFi AP"));
-  Serial.println(F("════════════════════════════════════════"));
+#if FC_USE_SAMPLE_TIMER
+void sampleTimerIsr(timer_callback_args_t*) {
+  sampleTickPending = true;
+}
+
+// Claim any free GPT/AGT channel; false leaves free-running polling on.
+bool startSampleTimer() {
+  uint8_t type = 0;
+  int8_t  channel = FspTimer::get_available_timer(type);
+  if (channel < 0) return false;
+  return sampleTimer.begin(TIMER_MODE_PERIODIC, type, channel,
+                           (float)SAMPLE_TICK_HZ, 0.0f, sampleTimerIsr) &&
+         sampleTimer.setup_overflow_irq() && sampleTimer.open() && sampleTimer.start();
+}
 
-  // ── 1. Start Wi-Fi Access Point ────────────────────────────────────────
-  Serial.print(F("[WiFi] Creating AP: "));
-  Serial.println(AP_SSID);
+// True once a polled lane's next sample is due.
+static bool laneDue(uint8_t ch, uint32_t now) {
+  return now - lastSampleMs[ch] >= lanePeriodMs(ch);
+}
+#endif
 
-  int apResult = WiFi.beginAP(AP_SSID, AP_PASSWORD);
-  if (apResult != WL_AP_LISTENING) {
-    Serial.println(F("[WiFi] AP FAILED — halting."));
-    while (true) { delay(1000); }
+/**
+ * True if there is time for one network pass before the next lane
+ * deadline.  Stalled lanes (overdue past SENSOR_TIMEOUT_MS) don't hold the
+ * network up, and it is never deferred for more than NET_MAX_DEFER_MS.
+ */
+bool networkSlotFree() {
+#if FC_USE_SAMPLE_TIMER
+  uint32_t now = millis();
+  if (!sampleTimerOn || now - lastNetMs >= NET_MAX_DEFER_MS) {
+    lastNetMs = now;
+    return true;
+  }
+  for (uint8_t ch = 0; ch < NUM_LANES; ch++) {
+    if (!bank.sensorOk(ch)) continue;
+    uint32_t period = lanePeriodMs(ch);
+    uint32_t age    = now - lastSampleMs[ch];
+    if (age > period + SENSOR_TIMEOUT_MS) continue;     // not on schedule
+    if (age + NET_SLOT_MS >= period) return false;      // due inside the slot
   }
+  lastNetMs = now;
+#endif
+  return true;
+}
 
+// ═══════════════════════════════════════════════════════════════════════════
+//  BOOT STAGES  –  run from loop() until the network is up
+// ═══════════════════════════════════════════════════════════════════════════
+
+// Bring up the Wi-Fi side: our own AP, or the aggregator's as a reporter.
+// Blocks for as long as the bridge still needs; false = retry later.
+static bool startNetwork() {
+#if FC_HUB_ROLE == FC_HUB_REPORTER
+  LOG_INFO("[WiFi] Joining aggregator AP: %s", AP_SSID);
+  if (!joinAggregator()) LOG_WARN("[WiFi] Join FAILED — retrying from loop()");
+  hubBootId = (uint16_t)(micros() ^ (micros() >> 16));
+  hubUdp.begin(HUB_UDP_PORT);
+#else
+  LOG_INFO("[WiFi] Creating AP: %s", AP_SSID);
+  if (WiFi.beginAP(AP_SSID, AP_PASSWORD) != WL_AP_LISTENING) {
+    LOG_ERROR("[WiFi] AP FAILED — retrying in %lu s", (unsigned long)(AP_RETRY_MS / 1000));
+    return false;
+  }
+#if FC_HUB_ROLE == FC_HUB_AGGREGATOR
+  hubUdp.begin(HUB_UDP_PORT);
+  LOG_INFO("[Hub]  Aggregating hub reports on UDP port %u", HUB_UDP_PORT);
+#endif
+#endif
+#if FC_LOG_LEVEL >= 3
   IPAddress ip = WiFi.localIP();
-  Serial.print(F("[WiFi] AP IP: "));
-  Serial.println(ip);
-  Serial.print(F("[WiFi] Open http://"));
-  Serial.print(ip);
-  Serial.println(F("/ in your browser"));
+  LOG_INFO("[WiFi] Open http://%u.%u.%u.%u/ in your browser", ip[0], ip[1], ip[2], ip[3]);
+#endif
+  return true;
+}
 
-  // ── 2. HTTP routes ─────────────────────────────────────────────────────
+// HTTP routes + WebSocket server (the AP is already up).
+static void startServers() {
   server.addRoute("/", handleRoot);
-
-  // Start web server (WiFi already connected via AP)
+  server.addRoute("/bins", handleBins);
+#if FC_METRICS
+  server.addRoute("/metrics", handleMetrics);
+#endif
   server.begin();
-  Serial.println(F("[HTTP] Server started on port 80"));
+  LOG_INFO("[HTTP] Server started on port 80");
 
-  // ── 3. WebSocket server ────────────────────────────────────────────────
   ws = server.enableWebSocket(81);
   if (ws) {
     ws->onOpen(onWsOpen);
     ws->onMessage(onWsMessage);
     ws->onClose(onWsClose);
-    Serial.println(F("[WS]   Server started on port 81"));
+    LOG_INFO("[WS]   Server started on port 81");
   } else {
-    Serial.println(F("[WS]   FAILED to start WebSocket server"));
+    LOG_ERROR("[WS]   FAILED to start WebSocket server");
   }
+}
 
-  Serial.print(F("[WS]   Client URL: ws://"));
-  Serial.print(ip);
-  Serial.println(F(":81"));
+// Advance the boot one stage at a time; lanes keep counting throughout.
+void serviceBoot(uint32_t now) {
+  switch (bootStage) {
+    case BootStage::CALIBRATE:
+      if (calibMask) return;          // beginAP() would starve the windows
+      if (!warmStart) LOG_INFO("[Cal] Done in %lu ms", (unsigned long)(now - calibStartMs));
+      bootStage = BootStage::NETWORK;
+      return;
 
-  // ── 4. Sensors ─────────────────────────────────────────────────────────
-  initSensors();
-  calibrateBaselines();
+    case BootStage::NETWORK:
+      if ((int32_t)(now - apRetryAtMs) < 0) return;
+      if (!startNetwork()) { apRetryAtMs = now + AP_RETRY_MS; return; }
+      boot.apMs = millis();
+      bootStage = BootStage::SERVERS;
+      return;
 
-  Serial.println(F("\n[✓] System ready — waiting for fuel balls …\n"));
+    case BootStage::SERVERS:
+      startServers();
+      boot.readyMs = millis();
+      bootStage    = BootStage::READY;
+      LOG_INFO("[Boot] sensors %lu ms, counting %lu ms, AP %lu ms, ready %lu ms",
+               (unsigned long)boot.sensorsMs, (unsigned long)boot.countingMs,
+               (unsigned long)boot.apMs, (unsigned long)boot.readyMs);
+      LOG_INFO("[✓] System ready — waiting for fuel balls …");
+      return;
+
+    case BootStage::READY:
+      return;
+  }
+}
+
+// ═══════════════════════════════════════════════════════════════════════════
+//  SETUP  –  sensors only; the rest is staged (see serviceBoot())
+// ═══════════════════════════════════════════════════════════════════════════
+
+void setup() {
+  Serial.begin(115200);             // no wait: boot lines are queued
+  LOG_INFO("════════════════════════════════════════");
+  LOG_INFO("  Hub Fuel Counter — UNO R4 WiFi AP");
+  LOG_INFO("════════════════════════════════════════");
+
+  // ── Sensors — warm start from EEPROM, else calibrate from loop() ──────
+  countBins.begin(millis(), COUNT_BIN_MS);
+  wsCommands.add(WS_COMMANDS, WS_COMMAND_COUNT);
+  warmStart = loadConfig();
+  if (warmStart) LOG_INFO("[Cfg] Stored calibration found — warm start");
+  else           LOG_INFO("[Cfg] No valid stored calibration");
+  initSensors();
+  if (warmStart) applyStoredCalibration();
+  else           beginCalibration(ALL_LANES_MASK);   // saved once it is done
+  attachLaneInterrupts();
+#if FC_USE_SAMPLE_TIMER
+  sampleTimerOn = startSampleTimer();
+  if (sampleTimerOn) LOG_INFO("[Tick] Sample timer running");
+  else               LOG_WARN("[Tick] No free timer — polling freely");
+#endif
+  boot.sensorsMs = millis();
+  bootStage      = BootStage::CALIBRATE;   // then Wi-Fi, then HTTP/WS
 }
 
 // ═══════════════════════════════════════════════════════════════════════════
@@ -449,29 +2333,113 @@ void setup() {
 // ═══════════════════════════════════════════════════════════════════════════
 
 void loop() {
-  // ── Service HTTP + WebSocket ──────────────────────────────────────────
-  server.handleClient();
-  server.handleWebSocket();
+  METRIC_START(tLoop);
 
-  // ── Poll all 4 ToF lanes via the mux ──────────────────────────────────
-  for (uint8_t ch = 0; ch < NUM_LANES; ch++) {
-    updateLane(ch);
+  // ── Service HTTP + WebSocket, draining sensor events around each ──────
+  // (with the sample timer, only in the slack between lane deadlines)
+  serviceLaneEvents();
+  if (networkUp() && networkSlotFree()) {
+    METRIC_START(tHttp);
+    server.handleClient();
+    METRIC_STOP(metrics.stage[STAGE_HTTP], tHttp);
+    serviceLaneEvents();
+  }
+  if (networkUp() && networkSlotFree()) {
+    METRIC_START(tWs);
+    server.handleWebSocket();
+    METRIC_STOP(metrics.stage[STAGE_WS], tWs);
+    serviceLaneEvents();
+  }
+
+  // ── Poll lanes without an interrupt line (or whose edge went missing) ─
+  METRIC_START(tSensors);
+  uint32_t nowMs = millis();
+  uint16_t dist[NUM_LANES];
+  uint32_t fresh = 0;
+#if FC_USE_SAMPLE_TIMER
+  // On each tick, only lanes whose sample is due; between ticks, none
+  bool tick = !sampleTimerOn || sampleTickPending;
+  sampleTickPending = false;
+#else
+  const bool tick = true;
+#endif
+  for (uint8_t ch = 0; ch < NUM_LANES && tick; ch++) {
+    // IRQ lanes are only polled once their edge is overdue (lost edge)
+    if (laneUsesIrq(ch) && (int32_t)(nowMs - lastSampleMs[ch]) < (int32_t)laneDeadlineMs(ch)) continue;
+#if FC_USE_SAMPLE_TIMER
+    if (sampleTimerOn && !laneDue(ch, nowMs)) continue;
+#endif
+    if (updateLane(ch, dist[ch])) fresh |= 1u << ch;
   }
 
-  // ── Broadcast counts to WebSocket clients if something changed ────────
+  // ── Filter, then one batch pass of the state machine over fresh lanes ─
+  fresh = filterBatch(dist, fresh & ~calibMask);
+  if (fresh) recordCounts(bank.processReadings(dist, lastSampleMs, fresh));
+  checkLaneTimeouts(millis());        // after the reads: stamps may be > nowMs
+  serviceCalibration();
+  serviceLaneHealth(millis());
+  METRIC_STOP(metrics.stage[STAGE_SENSORS], tSensors);
+
+  // ── Don't let a partial trace block sit around on a quiet hub ─────────
+  if (traceOn && traceEnc[traceFront].samples() &&
+      millis() - traceEnc[traceFront].baseTs() >= TRACE_FLUSH_MS) {
+    sealTrace();                      // sent from the idle point below
+  }
+
+  // ── Snapshots owed to newly connected clients ──────────────────────────
+  serviceSnapshotGrace();
+
+  // ── Fan count changes out to WebSocket clients, each at its own pace ──
   if (countsChanged) {
-    uint32_t now = millis();
-    if (now - lastBroadcastMs >= BROADCAST_MIN_INTERVAL_MS) {
-      if (ws && ws->connectedClients() > 0) {
-        String json = buildCountsJson();
-        ws->broadcastTXT(json);
-      }
-      countsChanged    = false;
-      lastBroadcastMs  = now;
+#if FC_HUB_ROLE != FC_HUB_STANDALONE
+    hubLocalChanged = true;
+#endif
+    queueCountsForClients();
+#if FC_METRICS
+    if (!ws || ws->connectedClients() == 0) metrics.unsent = false;
+#endif
+  }
+  {
+    METRIC_START(tBroadcast);
+    if (serviceBroadcasts(millis())) {
+      METRIC_STOP(metrics.stage[STAGE_BROADCAST], tBroadcast);
+#if FC_METRICS
+      if (metrics.unsent) metrics.countToSend.record(micros() - metrics.oldestUnsentUs);
+      metrics.unsent = false;
+#endif
     }
   }
 
+  // ── Report to / collect from the other hubs ───────────────────────────
+  if (networkUp()) serviceHubLink(millis());
+
+  // ── Bring the network up once the lanes are counting ──────────────────
+  if (!networkUp()) serviceBoot(millis());
+
+  // ── Persist calibration / profile changes (rare; off the sample path) ─
+  if (configDirty && !calibMask) saveConfig();   // once a calibration is done
+
+  // ── Periodic I2C bus-load report ──────────────────────────────────────
+  if (nowMs - lastBusReportMs >= BUS_STATS_INTERVAL_MS) {
+    LOG_INFO("[Bus] I2C transactions/s = %lu",
+             (unsigned long)((i2cTransactions - lastBusReportTx) * 1000UL /
+                             (nowMs - lastBusReportMs)));
+    lastBusReportTx = i2cTransactions;
+    lastBusReportMs = nowMs;
+  }
+
+  // ── Trickle out traces, logs and telemetry when no sensor work waits ──
+  if (!fresh && !laneReadyMask.load(std::memory_order_relaxed)) {
+    serviceTrace();
+    logDrain(LOG_DRAIN_MAX_BYTES);
+#if FC_TELEMETRY
+    serviceTelemetry(millis());
+#endif
+  }
+
+  METRIC_STOP(metrics.stage[STAGE_LOOP], tLoop);
+
   // No delay() here — the loop runs as fast as possible for responsive
-  // ball detection.  The ToF continuous-mode reads throttle naturally
-  // (~30 ms per sensor × 4 = ~120 ms full cycle ≈ 8 Hz per lane).
+  // ball detection.  updateLane() never waits on a conversion, so all
+  // sensors range concurrently and each lane is sampled at ~30 Hz.
 }
\ No newline at end of file
@@ -0,0 +1,281 @@
+/*******************************************************************************
+ * replay.cpp — Replay captured distance traces through the counter
+ *
+ * Feeds a trace captured from the hub (Serial dump or saved WebSocket TRACE
+ * frames, see trace_codec.h) through the fuel_counter state machine, once
+ * per parameter combination, as fast as the host can go.
+ *
+ *   pio run -e replay
+ *   .pio/build/replay/program match.trace \
+ *       --delta 50:120:10 --hyst 10:50:10 --lockout 30:120:15 --truth 412
+ *
+ * --dwell-pct R sweeps the adaptive lockout ratio (0 = fixed --lockout,
+ * which is then also the starting lockout for adaptive runs).  --multi N
+ * sets the most balls one pass may count as (1 = multi-ball detection off).
+ * --filter 0 feeds raw distances; by default they first pass the median-of-3
+ * stage of the firmware's sample filter (FC_SAMPLE_FILTER=1), since that
+ * changes dip depth and dwell.  Traces carry no range status or signal
+ * rate, so the reject stage can't be replayed.
+ *
+ * Ranges are min:max:step (or a single value).  Defaults match src/main.cpp.
+ * With --truth N the sweep is ranked by |total − N| and the best are shown.
+ * --csv FILE writes the decoded samples as ts_ms,lane,distance_mm for the
+ * native bench.
+ ******************************************************************************/
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "fuel_counter.h"
+#include "trace_codec.h"
+#include "calibration.h"
+#include "sample_filter.h"
+
+// ═══════════════════════════════════════════════════════════════════════════
+//  CONFIGURATION  (firmware defaults)
+// ═══════════════════════════════════════════════════════════════════════════
+
+static const uint16_t DEFAULT_DELTA_MM   = 80;
+static const uint16_t DEFAULT_HYST_MM    = 30;
+static const uint32_t DEFAULT_LOCKOUT_MS = 60;
+static const uint8_t  DEFAULT_DWELL_PCT  = 50;   // adaptive lockout
+static const uint16_t LOCKOUT_MIN_MS     = 15;
+static const uint16_t LOCKOUT_MAX_MS     = 120;
+static const uint8_t  DEFAULT_MULTI      = 3;    // MAX_BALLS_PER_PASS
+static const uint16_t MULTI_BALL_DIP_MM  = 20;
+static const uint8_t  DRIFT_SHIFT        = 6;    // baseline drift tracking
+static const uint16_t DRIFT_STEP_Q8      = 8;
+static const uint16_t DRIFT_WINDOW_MM    = 25;
+static const uint16_t DRIFT_LIMIT_MM     = 60;
+static const uint8_t  CALIB_SAMPLES      = 20;   // baseline from first N (median/MAD)
+static const size_t   DEFAULT_TOP        = 10;
+
+struct Range {
+  uint32_t lo, hi, step;
+  uint32_t steps() const { return (hi - lo) / step + 1; }
+  uint32_t at(uint32_t i) const { return lo + i * step; }
+};
+
+struct Result {
+  uint16_t delta, hyst;
+  uint32_t lockout;
+  uint8_t  dwellPct;
+  uint32_t total;
+  uint32_t lane[FC_TRACE_MAX_LANES];
+};
+
+// ═══════════════════════════════════════════════════════════════════════════
+//  TRACE LOADING
+// ═══════════════════════════════════════════════════════════════════════════
+
+/**
+ * Pull every valid block out of a raw capture, skipping anything that is
+ * not one (log text, a torn block at the start of a Serial dump).
+ */
+static bool loadTrace(const char* path, std::vector<TraceSample>& out,
+                      uint8_t& lanes, size_t& blocks, size_t& skipped)
+{
+  FILE* fp = std::fopen(path, "rb");
+  if (!fp) return false;
+  std::vector<uint8_t> raw;
+  uint8_t chunk[4096];
+  size_t n;
+  while ((n = std::fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+    raw.insert(raw.end(), chunk, chunk + n);
+  }
+  std::fclose(fp);
+
+  lanes = 0; blocks = 0; skipped = 0;
+  size_t off = 0;
+  TraceBlockReader reader;
+  while (off < raw.size()) {
+    if (raw[off] != FC_WS_MAGIC || !reader.open(&raw[off], raw.size() - off)) {
+      off++; skipped++;
+      continue;
+    }
+    TraceSample s;
+    while (reader.next(s)) out.push_back(s);
+    if (reader.lanes() > lanes) lanes = reader.lanes();
+    off += TraceBlockReader::check(&raw[off], raw.size() - off);
+    blocks++;
+  }
+  return true;
+}
+
+// Robust baseline from each lane's first readings, as calibrateBaselines()
+static void estimateBaselines(const std::vector<TraceSample>& samples,
+                              uint8_t lanes, uint16_t* baseline)
+{
+  static LaneCalibrator<CALIB_SAMPLES> cal[FC_TRACE_MAX_LANES];
+  for (uint8_t l = 0; l < lanes; l++) cal[l].begin();
+  for (const TraceSample& s : samples) cal[s.lane].add(s.dist_mm);
+  for (uint8_t l = 0; l < lanes; l++) {
+    uint16_t mad;
+    uint8_t  inliers;
+    if (!cal[l].result(baseline[l], mad, inliers)) baseline[l] = 0;
+  }
+}
+
+// Median-of-3 over each lane's readings, as SampleFilterBank does in the
+// firmware.  Parameter-independent, so it runs once before the sweep.
+static void filterSamples(std::vector<TraceSample>& samples) {
+  static SampleFilterBank<FC_TRACE_MAX_LANES> filter;
+  filter.configure(true, false, 0);
+  uint16_t d[FC_TRACE_MAX_LANES] = {};
+  for (TraceSample& s : samples) {
+    d[s.lane] = s.dist_mm;
+    filter.filterReadings(d, nullptr, nullptr, 1u << s.lane);
+    s.dist_mm = d[s.lane];
+  }
+}
+
+// ═══════════════════════════════════════════════════════════════════════════
+//  REPLAY
+// ═══════════════════════════════════════════════════════════════════════════
+
+static Result replay(const std::vector<TraceSample>& samples, uint8_t lanes,
+                     const uint16_t* baseline,
+                     uint16_t delta, uint16_t hyst, uint32_t lockout,
+                     uint8_t dwellPct, uint8_t multi)
+{
+  static LaneBank<FC_TRACE_MAX_LANES> bank;
+  bank = LaneBank<FC_TRACE_MAX_LANES>();
+  bank.setLockout(lockout);
+  bank.setAdaptiveLockout(dwellPct, LOCKOUT_MIN_MS, LOCKOUT_MAX_MS);
+  bank.setMultiBall(multi, MULTI_BALL_DIP_MM);
+  bank.setDriftTracking(DRIFT_SHIFT, DRIFT_STEP_Q8, DRIFT_WINDOW_MM, DRIFT_LIMIT_MM);
+  for (uint8_t l = 0; l < lanes; l++) {
+    if (!baseline[l]) continue;                   // lane never reported
+    bank.setSensorOk(l, true);
+    bank.calculateThresholds(l, baseline[l], delta, hyst);
+  }
+  for (const TraceSample& s : samples) bank.process(s.lane, s.dist_mm, s.ts_ms);
+
+  Result r = {};
+  r.delta = delta; r.hyst = hyst; r.lockout = lockout; r.dwellPct = dwellPct;
+  for (uint8_t l = 0; l < lanes; l++) { r.lane[l] = bank.count[l]; r.total += bank.count[l]; }
+  return r;
+}
+
+// ═══════════════════════════════════════════════════════════════════════════
+//  COMMAND LINE
+// ═══════════════════════════════════════════════════════════════════════════
+
+static bool parseRange(const char* arg, Range& r) {
+  unsigned long lo, hi, step;
+  int n = std::sscanf(arg, "%lu:%lu:%lu", &lo, &hi, &step);
+  if (n == 1) { r = { (uint32_t)lo, (uint32_t)lo, 1 }; return true; }
+  if (n == 3 && step > 0 && hi >= lo) { r = { (uint32_t)lo, (uint32_t)hi, (uint32_t)step }; return true; }
+  return false;
+}
+
+static void usage() {
+  std::fprintf(stderr,
+    "usage: replay TRACE [--delta R] [--hyst R] [--lockout R] [--dwell-pct R]\n"
+    "                    [--multi N] [--filter 0|1] [--truth N] [--top N] [--csv FILE]\n"
+    "       R = min:max:step or a single value\n");
+}
+
+static void printResult(const Result& r, uint8_t lanes) {
+  std::printf("%5u %5u %7lu %5u %7lu ", r.delta, r.hyst, (unsigned long)r.lockout,
+              r.dwellPct, (unsigned long)r.total);
+  for (uint8_t l = 0; l < lanes; l++) std::printf(" %6lu", (unsigned long)r.lane[l]);
+  std::printf("\n");
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) { usage(); return 2; }
+  const char* tracePath = argv[1];
+  const char* csvPath   = nullptr;
+  Range delta   = { DEFAULT_DELTA_MM,   DEFAULT_DELTA_MM,   1 };
+  Range hyst    = { DEFAULT_HYST_MM,    DEFAULT_HYST_MM,    1 };
+  Range lockout = { DEFAULT_LOCKOUT_MS, DEFAULT_LOCKOUT_MS, 1 };
+  Range dwell   = { DEFAULT_DWELL_PCT,  DEFAULT_DWELL_PCT,  1 };
+  long   truth = -1;
+  long   multi = DEFAULT_MULTI;
+  bool   filter = true;
+  size_t top   = DEFAULT_TOP;
+
+  for (int i = 2; i < argc; i++) {
+    const char* a = argv[i];
+    const char* v = (i + 1 < argc) ? argv[i + 1] : nullptr;
+    bool ok = v != nullptr;
+    if      (ok && !std::strcmp(a, "--delta"))   ok = parseRange(v, delta);
+    else if (ok && !std::strcmp(a, "--hyst"))    ok = parseRange(v, hyst);
+    else if (ok && !std::strcmp(a, "--lockout")) ok = parseRange(v, lockout);
+    else if (ok && !std::strcmp(a, "--dwell-pct")) ok = parseRange(v, dwell) && dwell.hi <= 255;
+    else if (ok && !std::strcmp(a, "--truth"))   truth = std::atol(v);
+    else if (ok && !std::strcmp(a, "--multi"))   ok = (multi = std::atol(v)) >= 1 && multi <= 255;
+    else if (ok && !std::strcmp(a, "--filter"))  filter = std::atol(v) != 0;
+    else if (ok && !std::strcmp(a, "--top"))     top = (size_t)std::atol(v);
+    else if (ok && !std::strcmp(a, "--csv"))     csvPath = v;
+    else ok = false;
+    if (!ok) { usage(); return 2; }
+    i++;
+  }
+
+  std::vector<TraceSample> samples;
+  uint8_t lanes;
+  size_t blocks, skipped;
+  if (!loadTrace(tracePath, samples, lanes, blocks, skipped) || samples.empty()) {
+    std::fprintf(stderr, "no trace blocks in %s\n", tracePath);
+    return 1;
+  }
+  double span_s = (samples.back().ts_ms - samples.front().ts_ms) / 1000.0;
+  std::printf("%s: %zu samples, %u lanes, %zu blocks, %zu bytes skipped, %.1f s\n",
+              tracePath, samples.size(), lanes, blocks, skipped, span_s);
+
+  if (csvPath) {
+    FILE* fp = std::fopen(csvPath, "w");
+    if (!fp) { std::fprintf(stderr, "cannot write %s\n", csvPath); return 1; }
+    std::fprintf(fp, "# ts_ms,lane,distance_mm\n");
+    for (const TraceSample& s : samples) {
+      std::fprintf(fp, "%lu,%u,%u\n", (unsigned long)s.ts_ms, s.lane, s.dist_mm);
+    }
+    std::fclose(fp);
+  }
+
+  uint16_t baseline[FC_TRACE_MAX_LANES];
+  estimateBaselines(samples, lanes, baseline);
+  std::printf("baseline_mm:");
+  for (uint8_t l = 0; l < lanes; l++) std::printf(" %u", baseline[l]);
+  std::printf("\n");
+
+  // Calibration samples bypass the filter in the firmware; counting doesn't
+  if (filter) filterSamples(samples);
+  std::printf("sample filter: %s\n\n", filter ? "median-of-3" : "off");
+
+  // ── Sweep every combination ───────────────────────────────────────────
+  std::vector<Result> results;
+  size_t runs = (size_t)delta.steps() * hyst.steps() * lockout.steps() * dwell.steps();
+  results.reserve(runs);
+  auto t0 = std::chrono::steady_clock::now();
+  for (uint32_t d = 0; d < delta.steps(); d++)
+    for (uint32_t h = 0; h < hyst.steps(); h++)
+      for (uint32_t k = 0; k < lockout.steps(); k++)
+        for (uint32_t w = 0; w < dwell.steps(); w++)
+          results.push_back(replay(samples, lanes, baseline,
+                                   (uint16_t)delta.at(d), (uint16_t)hyst.at(h),
+                                   lockout.at(k), (uint8_t)dwell.at(w),
+                                   (uint8_t)multi));
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  if (truth >= 0) {
+    std::stable_sort(results.begin(), results.end(), [&](const Result& a, const Result& b) {
+      return std::labs((long)a.total - truth) < std::labs((long)b.total - truth);
+    });
+    if (results.size() > top) results.resize(top);
+  }
+
+  std::printf("delta  hyst lockout dwell%%   total ");
+  for (uint8_t l = 0; l < lanes; l++) std::printf("  lane%-2u", l + 1);
+  std::printf("\n");
+  for (const Result& r : results) printResult(r, lanes);
+
+  std::printf("\n%zu runs in %.3f s  (%.0f samples/s, %.0fx real time)\n",
+              runs, wall, samples.size() * runs / wall, span_s * runs / wall);
+  return 0;
+}